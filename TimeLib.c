@@ -17,34 +17,45 @@
 	Author website: http://www.geekfactory.mx
 	Author e-mail: ruben at geekfactory dot mx
  */
+/* POSIX declarations on hosted builds, must come before any system header */
+#if (defined( __unix__ ) || defined( __APPLE__ )) && !defined( _POSIX_C_SOURCE )
+#define _POSIX_C_SOURCE		200809L
+#endif
+
 #include "TimeLib.h"
+#include "TimeLibCivil.h"
 
-/* Flag used to "freeze" the clock value */
-bool halt = false;
+#if defined(TIMELIB_PORT_POSIX)
+#include <time.h>
+#endif
 
-/* Stores the day count for each month */
-const unsigned char month_length[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+#if defined(CONFIG_TIMELIB_COARSE) && defined(TIMELIB_PORT_POSIX)
+#include <pthread.h>
+#endif
 
-/* Unix like time counter, keeps track of absolute time */
-timelib_t sys_time = 0;
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+#include <stddef.h>
+#include <string.h>
+#if defined(TIMELIB_PORT_POSIX)
+#include <stdio.h>
+#elif defined(ARDUINO) && defined(__AVR__)
+#include <avr/eeprom.h>
+#endif
+#endif
 
-/* The interval in seconds after which the system time variable should be updated
- * (synced) with an external (accurate) time base */
-timelib_t sync_interval = 86400;
-
-/* Unix timestamp when the sync should be done. */
-timelib_t sync_next = 0;
+/* Stores the day count for each month */
+const unsigned char month_length[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 
 /* Cache for current time */
 timelib_t tcache;
 struct timelib_tm telements;
 
-/* Variable used to keep track of the last time the "seconds" or sys_time counter
- * was updated in "tick" units */
-unsigned long last_update = 0;
-
-/* Keeps the status of the system time (ok, needs sync, not set, etc). */
-enum time_status tstatus = E_TIME_NOT_SET;
+/* Default clock instance, used by the functions without a clock parameter */
+struct timelib_clock sysclock = {0, TIMELIB_SECS_PER_DAY, 0, 0, 0, E_TIME_NOT_SET, false
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+	, 0, 0, 0
+#endif
+};
 
 /**
  * Stores a pointer to a function that returns a precise Unix timestamp to set
@@ -53,6 +64,116 @@ enum time_status tstatus = E_TIME_NOT_SET;
  */
 timelib_callback_t timelib_provider_callback = 0;
 
+/* Tick counter used by all clocks, null to use the port tick_get() */
+timelib_tick_source_t timelib_tick_source = 0;
+
+#if defined(CONFIG_TIMELIB_MONO)
+/* Seconds and ticks since startup at the last extending tick reading */
+uint32_t mono_secs = 0;
+unsigned long mono_frac = 0;
+unsigned long mono_last = 0;
+
+/* Sequence counter, odd while the monotonic counter is being extended */
+volatile unsigned int mono_seq = 0;
+#endif
+
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+/* Backend where clock checkpoints are stored */
+const struct timelib_storage * timelib_storage = 0;
+
+#if defined(TIMELIB_PORT_POSIX)
+/* Checkpoint file backend */
+const char * storage_path;
+struct timelib_storage storage_file;
+#elif defined(ARDUINO) && defined(__AVR__)
+/* Checkpoint EEPROM backend */
+uint16_t storage_address;
+struct timelib_storage storage_eeprom;
+#endif
+#endif
+
+#if defined(CONFIG_TIMELIB_COARSE)
+/* Timestamp published by the coarse clock ticker */
+volatile timelib_t coarse_time = 0;
+
+/* Milliseconds elapsed on the published second */
+volatile uint16_t coarse_ms = 0;
+
+/* Sequence counter, odd while the ticker is publishing a new value */
+volatile unsigned int coarse_seq = 0;
+
+#if defined(TIMELIB_PORT_POSIX)
+/* Serializes access to the default clock between the ticker and other threads */
+pthread_mutex_t coarse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Coarse clock background thread */
+pthread_t coarse_thread;
+volatile bool coarse_running = false;
+unsigned long coarse_period;
+#endif
+#endif
+
+#if defined(CONFIG_TIMELIB_COARSE)
+/*
+ * The coarse ticker also advances the default clock, other contexts lock it
+ * while they touch its fields. On microcontrollers the ticker runs from an
+ * interrupt and does not lock, the interrupt cannot be preempted by the code
+ * that holds the lock. Locks do not nest, so a single variable keeps the
+ * interrupt state saved by the holder.
+ */
+timelib_port_state_t lock_state;
+
+#define TIMELIB_CLOCK_LOCK(c)		do { if ((c) == &sysclock) timelib_port_lock(lock_state); } while (0)
+#define TIMELIB_CLOCK_UNLOCK(c)		do { if ((c) == &sysclock) timelib_port_unlock(lock_state); } while (0)
+#if defined(TIMELIB_PORT_POSIX)
+#define TIMELIB_TICKER_LOCK()		timelib_port_lock(lock_state)
+#define TIMELIB_TICKER_UNLOCK()		timelib_port_unlock(lock_state)
+#else
+#define TIMELIB_TICKER_LOCK()
+#define TIMELIB_TICKER_UNLOCK()
+#endif
+#else
+#define TIMELIB_CLOCK_LOCK(c)
+#define TIMELIB_CLOCK_UNLOCK(c)
+#endif
+
+#if defined(CONFIG_TIMELIB_STATS)
+#if !defined(TIMELIB_STATS_CLOCK)
+#define TIMELIB_STATS_CLOCK()		tick_get()
+#endif
+
+/* Runtime statistics counters */
+struct timelib_stats tstats;
+
+#define TIMELIB_STATS_ADD(field, n)	timelib_atomic_add(&tstats.field, (n))
+#define TIMELIB_STATS_DECLARE(t)	unsigned long t
+#define TIMELIB_STATS_START(t)		(t) = TIMELIB_STATS_CLOCK()
+#define TIMELIB_STATS_LATENCY(hist, t)	timelib_stats_latency(tstats.hist, TIMELIB_STATS_CLOCK() - (t))
+
+/**
+ * Records a latency sample on the given histogram
+ *
+ * @param hist The histogram to update
+ * @param elapsed The measured latency in TIMELIB_STATS_CLOCK() units
+ */
+static void timelib_stats_latency(uint32_t * hist, unsigned long elapsed)
+{
+	uint8_t i = 0;
+
+	// Bucket index is the position of the most significant bit set
+	while (elapsed != 0 && i < CONFIG_TIMELIB_STATS_BUCKETS - 1) {
+		elapsed >>= 1;
+		i++;
+	}
+	timelib_atomic_add(&hist[i], 1);
+}
+#else
+#define TIMELIB_STATS_ADD(field, n)
+#define TIMELIB_STATS_DECLARE(t)
+#define TIMELIB_STATS_START(t)
+#define TIMELIB_STATS_LATENCY(hist, t)
+#endif
+
 /**
  * @brief Computes if the given year is a leap year
  *
@@ -66,6 +187,265 @@ static int timelib_is_leap(unsigned int year)
 	return((year % 4 == 0 && year % 100 != 0) || year % 400 == 0);
 }
 
+/**
+ * Computes the civil date for the given day count in constant time
+ *
+ * @param days Days elapsed since Jan 1, 1970
+ * @param timeinfo Pointer to the structure where year, month and day are stored
+ */
+static void timelib_civil(uint32_t days, struct timelib_tm * timeinfo)
+{
+	uint32_t year;
+	uint8_t month, day;
+
+	timelib_civil_from_days(days, &year, &month, &day);
+	timeinfo->tm_mday = day;
+	timeinfo->tm_mon = month;
+	timeinfo->tm_year = (uint8_t) (year - 1970);
+}
+
+#if defined(CONFIG_TIMELIB_MONO)
+/**
+ * Extends the monotonic counter with a tick reading
+ *
+ * There is a single writer: the coarse ticker when it is enabled, otherwise
+ * the context that uses the library. Readers never write, so a wrap around
+ * cannot be counted twice.
+ *
+ * @param tick The tick reading
+ */
+static void timelib_mono_extend(unsigned long tick)
+{
+	unsigned int seq = mono_seq;
+
+	timelib_atomic_store(&mono_seq, seq + 1);
+	timelib_atomic_fence_release();
+	// Wrap arounds are absorbed by the unsigned subtraction
+	mono_frac += tick - mono_last;
+	mono_last = tick;
+	if (mono_frac >= (unsigned long) TICK_SECOND) {
+		mono_secs += (uint32_t) (mono_frac / (unsigned long) TICK_SECOND);
+		mono_frac %= (unsigned long) TICK_SECOND;
+	}
+	timelib_atomic_store_release(&mono_seq, seq + 2);
+}
+
+/**
+ * Gets the microseconds of the monotonic clock at a tick reading
+ *
+ * @param tick The tick reading, may be slightly older than the last one
+ * used to extend the counter
+ *
+ * @return Microseconds elapsed since startup
+ */
+static uint64_t timelib_mono_at(unsigned long tick)
+{
+	unsigned int seq;
+	unsigned long frac, last, back;
+	uint32_t secs, us;
+
+	do {
+		seq = timelib_atomic_load_acquire(&mono_seq);
+		secs = mono_secs;
+		frac = mono_frac;
+		last = mono_last;
+		timelib_atomic_fence_acquire();
+	} while ((seq & 1) || seq != timelib_atomic_load(&mono_seq));
+
+	// The ticker may have extended the counter after this tick was read
+	if ((long) (tick - last) >= 0) {
+		frac += tick - last;
+	} else {
+		back = last - tick;
+		secs -= (uint32_t) (back / (unsigned long) TICK_SECOND);
+		back %= (unsigned long) TICK_SECOND;
+		if (back > frac) {
+			secs--;
+			frac += (unsigned long) TICK_SECOND;
+		}
+		frac -= back;
+	}
+	secs += (uint32_t) (frac / (unsigned long) TICK_SECOND);
+	frac %= (unsigned long) TICK_SECOND;
+	// Split on the second so only 32 bit divisions are needed
+	if (1000000UL % (unsigned long) TICK_SECOND == 0)
+		us = (uint32_t) (frac * (1000000UL / (unsigned long) TICK_SECOND));
+	else
+		us = (uint32_t) (((uint64_t) frac * 1000000ULL) / (unsigned long) TICK_SECOND);
+	return(uint64_t) secs * 1000000ULL + us;
+}
+#endif
+
+/**
+ * Sets the time of a clock at the given tick count
+ *
+ * @param clock The clock to set
+ * @param now The Unix timestamp to set
+ * @param tick The tick count that corresponds to the given timestamp
+ */
+static void timelib_clock_step(struct timelib_clock * clock, timelib_t now, unsigned long tick)
+{
+	clock->time = now;
+	clock->sync_next = now + clock->sync_interval;
+	clock->status = E_TIME_OK;
+	clock->last_update = tick;
+}
+
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+/**
+ * Updates the drift estimate of a clock with the result of a provider sync
+ *
+ * @param clock The clock being synced
+ * @param now The timestamp returned by the provider
+ * @param tick The tick count when the provider returned
+ */
+static void timelib_clock_drift(struct timelib_clock * clock, timelib_t now, unsigned long tick)
+{
+	int32_t error, sample;
+	timelib_t span;
+
+	// Estimate only between two provider syncs of a running clock
+	if ((clock->status == E_TIME_OK || clock->status == E_TIME_NEEDS_SYNC) && clock->last_sync != 0 && now > clock->last_sync) {
+		// Compare with the clock time caught up to the sync tick
+		error = (int32_t) (clock->time + (timelib_t) ((tick - clock->last_update) / (unsigned long) TICK_SECOND) - now);
+		span = now - clock->last_sync;
+		if (span > 0x7FFFFFFFUL)
+			span = 0x7FFFFFFFUL;
+		// Larger errors are not drift and would overflow 32 bits, drop them
+		if (error <= 2147 && error >= -2147) {
+			sample = (error * 1000000L) / (int32_t) span;
+			// Smooth the one second resolution of each sample
+			if (sample <= CONFIG_TIMELIB_DRIFT_MAX && sample >= -CONFIG_TIMELIB_DRIFT_MAX)
+				clock->drift += (sample - clock->drift) / 4;
+		}
+	}
+	clock->last_sync = now;
+}
+#endif
+
+/**
+ * Syncs a clock with its provider if a sync is due
+ *
+ * The provider is called without holding the clock lock, so a coarse ticker
+ * keeps running while a slow provider is queried.
+ *
+ * @param clock The clock to sync
+ * @param tick The current tick count, updated if the clock was set
+ */
+static void timelib_clock_sync(struct timelib_clock * clock, unsigned long * tick)
+{
+	timelib_clock_callback_t provider;
+	timelib_t now;
+	bool due;
+	TIMELIB_STATS_DECLARE(t0);
+
+	// Check if time needs sync to timebase
+	TIMELIB_CLOCK_LOCK(clock);
+	provider = clock->provider;
+	due = provider != 0 && clock->halt == false && clock->sync_next <= clock->time;
+	TIMELIB_CLOCK_UNLOCK(clock);
+	if (!due)
+		return;
+
+	TIMELIB_STATS_ADD(provider_calls, 1);
+	TIMELIB_STATS_START(t0);
+	// Invoke callback function
+	now = provider(clock);
+	TIMELIB_STATS_LATENCY(provider_latency, t0);
+
+	TIMELIB_CLOCK_LOCK(clock);
+	// Got time from callback?
+	if (now != 0) {
+		// The provider may take a while, its time is valid when it returns
+		*tick = timelib_get_ticks();
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+		timelib_clock_drift(clock, now, *tick);
+#endif
+		timelib_clock_step(clock, now, *tick);
+	} else {
+		TIMELIB_STATS_ADD(provider_failures, 1);
+		clock->sync_next = clock->time + clock->sync_interval;
+		// Keep the not set and restored states until the first sync
+		if (clock->status == E_TIME_OK)
+			clock->status = E_TIME_NEEDS_SYNC;
+	}
+	TIMELIB_CLOCK_UNLOCK(clock);
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+	// Only the default clock is saved automatically, see timelib_clock_checkpoint()
+	if (now != 0 && clock == &sysclock)
+		timelib_clock_checkpoint(clock, false);
+#endif
+}
+
+/**
+ * Advances the time counter of a clock, the caller holds the clock lock
+ *
+ * @param clock The clock to update
+ * @param tick The current tick count
+ *
+ * @return The milliseconds elapsed on the current second of the clock
+ */
+static uint16_t timelib_clock_advance(struct timelib_clock * clock, unsigned long tick)
+{
+	unsigned long elapsed;
+
+	// Check how many seconds have elapsed (if any) since the last call
+	// and update the timestamp counter
+	elapsed = tick - clock->last_update;
+	if (elapsed >= TICK_SECOND) {
+		elapsed /= (unsigned long) TICK_SECOND;
+		clock->time += (timelib_t) elapsed;
+		clock->last_update += elapsed * (unsigned long) TICK_SECOND;
+		TIMELIB_STATS_ADD(catchup_runs, 1);
+		TIMELIB_STATS_ADD(catchup_seconds, elapsed);
+	}
+	return(uint16_t) (((tick - clock->last_update) * 1000UL) / (unsigned long) TICK_SECOND);
+}
+
+/**
+ * Syncs a clock if needed and reads it with the fraction of second elapsed
+ * from a single tick reading
+ *
+ * @param clock The clock to read
+ * @param ms Receives the milliseconds elapsed on the returned second, zero
+ * while the clock is halted
+ * @param at Receives the tick reading used, may be null
+ *
+ * @return The Unix timestamp of the clock
+ */
+static timelib_t timelib_clock_read(struct timelib_clock * clock, uint16_t * ms, unsigned long * at)
+{
+	unsigned long tick;
+	timelib_t now;
+
+	TIMELIB_STATS_ADD(get_calls, 1);
+	tick = timelib_get_ticks();
+	timelib_clock_sync(clock, &tick);
+
+	*ms = 0;
+	TIMELIB_CLOCK_LOCK(clock);
+	if (clock->halt == false)
+		*ms = timelib_clock_advance(clock, tick);
+	now = clock->time;
+	TIMELIB_CLOCK_UNLOCK(clock);
+	if (at != 0)
+		*at = tick;
+	return now;
+}
+
+/**
+ * Adapter that lets the default clock call a timelib_callback_t provider
+ *
+ * @param clock Not used
+ *
+ * @return The timestamp returned by the configured provider
+ */
+static timelib_t timelib_legacy_provider(struct timelib_clock * clock)
+{
+	(void) clock;
+	return timelib_provider_callback();
+}
+
 /**
  * Updates the time structure if time has changed
  *
@@ -74,71 +454,56 @@ static int timelib_is_leap(unsigned int year)
 static void timelib_update(timelib_t time)
 {
 	if (tcache != time) {
+		TIMELIB_STATS_ADD(cache_misses, 1);
 		tcache = time;
 		timelib_break(time, &telements);
+	} else {
+		TIMELIB_STATS_ADD(cache_hits, 1);
 	}
 }
 
 /*-------------------------------------------------------------*
  *	Public API, check TimeLib.h for documentation		*
  *-------------------------------------------------------------*/
+#if defined(TIMELIB_PORT_POSIX)
+
+unsigned long timelib_port_ticks(unsigned long hz)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(unsigned long) ts.tv_sec * hz + (unsigned long) ts.tv_nsec / (1000000000ul / hz);
+}
+#endif
+
 void timelib_set(timelib_t now)
 {
-	sys_time = now;
-	sync_next = now + sync_interval;
-	tstatus = E_TIME_OK;
-	last_update = tick_get();
+	timelib_clock_set(&sysclock, now);
 }
 
 timelib_t timelib_get()
 {
-	timelib_t now = 0;
-
-	// Clock halted, return always the same value (no update)
-	if (halt == true)
-		return sys_time;
-
-	// Check if time needs sync to timebase
-	if (sync_next <= sys_time) {
-		// Null pointer check
-		if (timelib_provider_callback != 0) {
-			// Invoke callback function
-			now = timelib_provider_callback();
-			// Got time from callback?
-			if (now != 0) {
-				timelib_set(now);
-			} else {
-				sync_next = sys_time + sync_interval;
-				tstatus = (tstatus == E_TIME_NOT_SET) ? E_TIME_NOT_SET : E_TIME_NEEDS_SYNC;
-			}
-		}
-	}
-
-	// Check how many seconds have elapsed (if any) since the last call
-	// and update the timestamp counter
-	while (tick_get() - last_update >= TICK_SECOND) {
-		// Increment timestamp
-		sys_time++;
-		last_update += TICK_SECOND;
-	}
-
-	return sys_time;
+	return timelib_clock_get(&sysclock);
 }
 
 void timelib_halt_clock()
 {
-	halt = true;
+	timelib_clock_halt(&sysclock);
 }
 
 void timelib_resume_clock()
 {
-	halt = false;
+	timelib_clock_resume(&sysclock);
 }
 
 uint8_t timelib_get_status()
 {
-	timelib_get();
-	return tstatus;
+	return timelib_clock_get_status(&sysclock);
+}
+
+timelib_t timelib_now_tm(struct timelib_tm * timeinfo, uint16_t * ms)
+{
+	return timelib_clock_now_tm(&sysclock, timeinfo, ms);
 }
 
 uint8_t timelib_second_t(timelib_t time)
@@ -222,7 +587,9 @@ timelib_t timelib_make(struct timelib_tm * timeinfo)
 {
 	int i;
 	timelib_t tstamp;
+	TIMELIB_STATS_DECLARE(t0);
 
+	TIMELIB_STATS_START(t0);
 	// Compute the number of seconds since the year 1970 to the begining of
 	// the given year on the structure, add to the output value
 	tstamp = timeinfo->tm_year * (TIMELIB_SECS_PER_DAY * 365);
@@ -245,16 +612,17 @@ timelib_t timelib_make(struct timelib_tm * timeinfo)
 	tstamp += (timelib_t) timeinfo->tm_min * (timelib_t) TIMELIB_SECS_PER_MINUTE;
 	tstamp += (timelib_t) timeinfo->tm_sec;
 
+	TIMELIB_STATS_ADD(conversions, 1);
+	TIMELIB_STATS_LATENCY(conversion_latency, t0);
 	return tstamp;
 }
 
 void timelib_break(timelib_t timeinput, struct timelib_tm * timeinfo)
 {
-	uint8_t year;
-	uint8_t month, monthLength;
 	uint32_t time;
-	unsigned long days;
+	TIMELIB_STATS_DECLARE(t0);
 
+	TIMELIB_STATS_START(t0);
 	time = (uint32_t) timeinput;
 	timeinfo->tm_sec = time % 60;
 
@@ -267,39 +635,10 @@ void timelib_break(timelib_t timeinput, struct timelib_tm * timeinfo)
 	time /= 24; // now it is days
 	timeinfo->tm_wday = ((time + 4) % 7) + 1; // Sunday is day 1
 
-	year = 0;
-	days = 0;
-	while ((unsigned) (days += (timelib_is_leap(1970 + year) ? 366 : 365)) <= time)
-		year++;
-
-	timeinfo->tm_year = year; // year is offset from 1970
-
-	days -= timelib_is_leap(1970 + year) ? 366 : 365;
-	time -= days; // now it is days in this year, starting at 0
-
-	days = 0;
-	month = 0;
-	monthLength = 0;
-	for (month = 0; month < 12; month++) {
-		// Check
-		if (month == 1) {
-			if (timelib_is_leap(1970 + year)) {
-				monthLength = 29;
-			} else {
-				monthLength = 28;
-			}
-		} else {
-			monthLength = month_length[month];
-		}
+	timelib_civil(time, timeinfo);
 
-		if (time >= monthLength) {
-			time -= monthLength;
-		} else {
-			break;
-		}
-	}
-	timeinfo->tm_mon = month + 1; // jan is month 1
-	timeinfo->tm_mday = time + 1; // day of month
+	TIMELIB_STATS_ADD(conversions, 1);
+	TIMELIB_STATS_LATENCY(conversion_latency, t0);
 }
 
 void timelib_set_provider(timelib_callback_t callback, timelib_t timespan)
@@ -307,12 +646,587 @@ void timelib_set_provider(timelib_callback_t callback, timelib_t timespan)
 	// Check null pointer
 	if (callback == 0)
 		return;
-	// Set new callback
+	// Set new callback, the default clock reaches it through an adapter
 	timelib_provider_callback = callback;
+	timelib_clock_set_provider(&sysclock, timelib_legacy_provider, timespan);
+}
+
+void timelib_set_tick_source(timelib_tick_source_t source)
+{
+	timelib_tick_source = source;
+}
+
+unsigned long timelib_get_ticks()
+{
+	unsigned long tick;
+
+	tick = (timelib_tick_source != 0) ? timelib_tick_source() : (unsigned long) tick_get();
+#if defined(CONFIG_TIMELIB_MONO) && !defined(CONFIG_TIMELIB_COARSE)
+	// Without a ticker every reading extends the monotonic counter
+	timelib_mono_extend(tick);
+#endif
+	return tick;
+}
+
+#if defined(CONFIG_TIMELIB_MONO)
+uint64_t timelib_mono_us()
+{
+	return timelib_mono_at(timelib_get_ticks());
+}
+
+timelib_t timelib_clock_mono_to_wall(struct timelib_clock * clock, uint64_t mono, uint16_t * ms)
+{
+	unsigned long tick;
+	uint64_t wall;
+	timelib_t now;
+	uint16_t frac;
+
+	// Clock and monotonic counter at the same tick reading
+	now = timelib_clock_read(clock, &frac, &tick);
+	wall = (uint64_t) now * 1000000ULL + (uint64_t) frac * 1000ULL;
+	wall += mono - timelib_mono_at(tick);
+	if (ms != 0)
+		*ms = (uint16_t) ((wall / 1000ULL) % 1000ULL);
+	return(timelib_t) (wall / 1000000ULL);
+}
+
+timelib_t timelib_mono_to_wall(uint64_t mono, uint16_t * ms)
+{
+	return timelib_clock_mono_to_wall(&sysclock, mono, ms);
+}
+#endif
+
+void timelib_clock_init(struct timelib_clock * clock)
+{
+	clock->time = 0;
+	clock->sync_interval = TIMELIB_SECS_PER_DAY;
+	clock->sync_next = 0;
+	clock->last_update = 0;
+	clock->provider = 0;
+	clock->status = E_TIME_NOT_SET;
+	clock->halt = false;
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+	clock->last_sync = 0;
+	clock->last_save = 0;
+	clock->drift = 0;
+#endif
+}
+
+void timelib_clock_set(struct timelib_clock * clock, timelib_t now)
+{
+	TIMELIB_CLOCK_LOCK(clock);
+	timelib_clock_step(clock, now, timelib_get_ticks());
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+	// Not a provider time, the next sync starts a new drift span
+	clock->last_sync = 0;
+#endif
+	TIMELIB_CLOCK_UNLOCK(clock);
+}
+
+timelib_t timelib_clock_get(struct timelib_clock * clock)
+{
+	uint16_t ms;
+
+	// A halted clock returns always the same value (no update)
+	return timelib_clock_read(clock, &ms, 0);
+}
+
+void timelib_clock_halt(struct timelib_clock * clock)
+{
+	TIMELIB_CLOCK_LOCK(clock);
+	clock->halt = true;
+	TIMELIB_CLOCK_UNLOCK(clock);
+}
+
+void timelib_clock_resume(struct timelib_clock * clock)
+{
+	TIMELIB_CLOCK_LOCK(clock);
+	clock->halt = false;
+	TIMELIB_CLOCK_UNLOCK(clock);
+}
+
+uint8_t timelib_clock_get_status(struct timelib_clock * clock)
+{
+	timelib_clock_get(clock);
+	return clock->status;
+}
+
+timelib_t timelib_clock_now_tm(struct timelib_clock * clock, struct timelib_tm * timeinfo, uint16_t * ms)
+{
+	timelib_t now;
+	uint16_t frac;
+
+	now = timelib_clock_read(clock, &frac, 0);
+	// Break on the caller structure, the shared cache is not reentrant
+	timelib_break(now, timeinfo);
+	if (ms != 0)
+		*ms = frac;
+	return now;
+}
+
+void timelib_clock_set_provider(struct timelib_clock * clock, timelib_clock_callback_t callback, timelib_t timespan)
+{
+	// Check null pointer
+	if (callback == 0)
+		return;
+	TIMELIB_CLOCK_LOCK(clock);
+	// Set new callback
+	clock->provider = callback;
 	// Enforce sync interval restrictions
-	sync_interval = (timespan == 0) ? TIMELIB_SECS_PER_DAY : timespan;
+	clock->sync_interval = (timespan == 0) ? TIMELIB_SECS_PER_DAY : timespan;
 	//Set next sync time to actual time
-	sync_next = sys_time;
+	clock->sync_next = clock->time;
+	TIMELIB_CLOCK_UNLOCK(clock);
 	// Force time sync
-	timelib_get();
+	timelib_clock_get(clock);
+}
+
+void timelib_clock_advance_all(struct timelib_clock * clocks, size_t count)
+{
+	unsigned long tick, tick0;
+	size_t i;
+
+	tick0 = timelib_get_ticks();
+	for (i = 0; i < count; i++) {
+		tick = tick0;
+		TIMELIB_STATS_ADD(get_calls, 1);
+		timelib_clock_sync(&clocks[i], &tick);
+		TIMELIB_CLOCK_LOCK(&clocks[i]);
+		if (clocks[i].halt == false)
+			timelib_clock_advance(&clocks[i], tick);
+		TIMELIB_CLOCK_UNLOCK(&clocks[i]);
+	}
+}
+
+timelib_packed_t timelib_pack(timelib_t time)
+{
+	struct timelib_tm tinfo;
+	uint32_t secs;
+
+	timelib_civil(time / TIMELIB_SECS_PER_DAY, &tinfo);
+	secs = time % TIMELIB_SECS_PER_DAY;
+	tinfo.tm_hour = (uint8_t) (secs / TIMELIB_SECS_PER_HOUR);
+	tinfo.tm_min = (uint8_t) ((secs / TIMELIB_SECS_PER_MINUTE) % 60);
+	tinfo.tm_sec = (uint8_t) (secs % 60);
+	return timelib_pack_tm(&tinfo);
+}
+
+timelib_t timelib_unpack(timelib_packed_t packed)
+{
+	timelib_t time;
+
+	time = timelib_civil_days(timelib_tm2calendar((uint32_t) timelib_packed_year(packed)),
+		timelib_packed_month(packed), timelib_packed_day(packed)) * TIMELIB_SECS_PER_DAY;
+	time += timelib_packed_hour(packed) * TIMELIB_SECS_PER_HOUR;
+	time += timelib_packed_minute(packed) * TIMELIB_SECS_PER_MINUTE;
+	time += timelib_packed_second(packed);
+	return time;
+}
+
+timelib_packed_t timelib_pack_tm(const struct timelib_tm * timeinfo)
+{
+	// Check packed range
+	if (timeinfo->tm_year < CONFIG_TIMELIB_PACKED_BASE || timeinfo->tm_year - CONFIG_TIMELIB_PACKED_BASE > 0x3F)
+		return TIMELIB_PACKED_INVALID;
+
+	return((timelib_packed_t) (timeinfo->tm_year - CONFIG_TIMELIB_PACKED_BASE) << 26)
+		| ((timelib_packed_t) (timeinfo->tm_mon & 0x0F) << 22)
+		| ((timelib_packed_t) (timeinfo->tm_mday & 0x1F) << 17)
+		| ((timelib_packed_t) (timeinfo->tm_hour & 0x1F) << 12)
+		| ((timelib_packed_t) (timeinfo->tm_min & 0x3F) << 6)
+		| (timelib_packed_t) (timeinfo->tm_sec & 0x3F);
+}
+
+void timelib_unpack_tm(timelib_packed_t packed, struct timelib_tm * timeinfo)
+{
+	uint32_t days;
+
+	timeinfo->tm_sec = timelib_packed_second(packed);
+	timeinfo->tm_min = timelib_packed_minute(packed);
+	timeinfo->tm_hour = timelib_packed_hour(packed);
+	timeinfo->tm_mday = timelib_packed_day(packed);
+	timeinfo->tm_mon = timelib_packed_month(packed);
+	timeinfo->tm_year = timelib_packed_year(packed);
+	days = timelib_civil_days(timelib_tm2calendar((uint32_t) timeinfo->tm_year), timeinfo->tm_mon, timeinfo->tm_mday);
+	timeinfo->tm_wday = ((days + 4) % 7) + 1; // Sunday is day 1
+}
+
+void timelib_pack_array(const timelib_t * times, timelib_packed_t * packed, size_t count)
+{
+	struct timelib_tm tinfo;
+	timelib_t midnight = 0;
+	uint32_t secs;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		secs = times[i] - midnight;
+		// Compute the date only when the day changes
+		if (i == 0 || secs >= TIMELIB_SECS_PER_DAY) {
+			midnight = timelib_prev_midnight(times[i]);
+			timelib_civil(times[i] / TIMELIB_SECS_PER_DAY, &tinfo);
+			secs = times[i] - midnight;
+		}
+		tinfo.tm_hour = (uint8_t) (secs / TIMELIB_SECS_PER_HOUR);
+		tinfo.tm_min = (uint8_t) ((secs / TIMELIB_SECS_PER_MINUTE) % 60);
+		tinfo.tm_sec = (uint8_t) (secs % 60);
+		packed[i] = timelib_pack_tm(&tinfo);
+	}
+}
+
+void timelib_unpack_array(const timelib_packed_t * packed, timelib_t * times, size_t count)
+{
+	timelib_packed_t date = TIMELIB_PACKED_INVALID;
+	timelib_t midnight = 0;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		// Compute the day count only when the date changes
+		if (timelib_packed_date(packed[i]) != date) {
+			date = timelib_packed_date(packed[i]);
+			midnight = timelib_unpack(date);
+		}
+		times[i] = midnight + timelib_packed_hour(packed[i]) * TIMELIB_SECS_PER_HOUR
+			+ timelib_packed_minute(packed[i]) * TIMELIB_SECS_PER_MINUTE
+			+ timelib_packed_second(packed[i]);
+	}
+}
+
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+/**
+ * Computes the checksum byte of a checkpoint record
+ *
+ * @param cp The checkpoint record
+ *
+ * @return The value that makes the sum of all bytes of the record zero
+ */
+static uint8_t timelib_checkpoint_sum(const struct timelib_checkpoint * cp)
+{
+	const uint8_t * p = (const uint8_t *) cp;
+	uint8_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < offsetof(struct timelib_checkpoint, checksum); i++)
+		sum += p[i];
+	return(uint8_t) (0 - sum);
+}
+
+void timelib_set_storage(const struct timelib_storage * storage)
+{
+	timelib_storage = storage;
+}
+
+bool timelib_clock_checkpoint(struct timelib_clock * clock, bool force)
+{
+	struct timelib_checkpoint cp;
+
+	if (timelib_storage == 0 || timelib_storage->write == 0)
+		return false;
+	memset(&cp, 0, sizeof(cp));
+	TIMELIB_CLOCK_LOCK(clock);
+	// Save the time now, not the one of the last read
+	if (clock->halt == false)
+		timelib_clock_advance(clock, timelib_get_ticks());
+	cp.magic = TIMELIB_CHECKPOINT_MAGIC;
+	cp.time = clock->time;
+	cp.last_sync = clock->last_sync;
+	cp.drift = clock->drift;
+	cp.status = clock->status;
+	// Nothing worth saving, rate limit writes to spare flash wear
+	if (cp.status == E_TIME_NOT_SET || (!force && clock->last_save != 0 && cp.time - clock->last_save < timelib_storage->interval))
+		cp.magic = 0;
+	TIMELIB_CLOCK_UNLOCK(clock);
+	if (cp.magic == 0)
+		return false;
+
+	// Storage writes may be slow, the clock is not locked meanwhile
+	cp.checksum = timelib_checkpoint_sum(&cp);
+	if (!timelib_storage->write(clock, &cp, sizeof(cp)))
+		return false;
+	TIMELIB_CLOCK_LOCK(clock);
+	clock->last_save = cp.time;
+	TIMELIB_CLOCK_UNLOCK(clock);
+	return true;
+}
+
+bool timelib_clock_restore(struct timelib_clock * clock)
+{
+	struct timelib_checkpoint cp;
+	timelib_t estimate;
+
+	if (timelib_storage == 0 || timelib_storage->read == 0)
+		return false;
+	if (!timelib_storage->read(clock, &cp, sizeof(cp)))
+		return false;
+	if (cp.magic != TIMELIB_CHECKPOINT_MAGIC || cp.checksum != timelib_checkpoint_sum(&cp) || cp.time == 0)
+		return false;
+
+	// The saved time was counted by the local oscillator since the last
+	// sync, remove the error that the drift estimate predicts for that span
+	estimate = cp.time;
+	if (cp.last_sync != 0 && cp.time > cp.last_sync)
+		estimate -= (timelib_t) (((int64_t) cp.drift * (int64_t) (cp.time - cp.last_sync)) / 1000000LL);
+
+	// Run from the estimated time and sync as soon as possible
+	TIMELIB_CLOCK_LOCK(clock);
+	timelib_clock_step(clock, estimate, timelib_get_ticks());
+	clock->status = E_TIME_RESTORED;
+	clock->sync_next = estimate;
+	clock->last_sync = cp.last_sync;
+	clock->last_save = estimate;
+	clock->drift = cp.drift;
+	TIMELIB_CLOCK_UNLOCK(clock);
+	return true;
+}
+
+bool timelib_checkpoint(bool force)
+{
+	return timelib_clock_checkpoint(&sysclock, force);
+}
+
+bool timelib_restore()
+{
+	return timelib_clock_restore(&sysclock);
+}
+
+#if defined(TIMELIB_PORT_POSIX)
+/**
+ * Reads a checkpoint record from the configured file
+ */
+static bool timelib_storage_file_read(struct timelib_clock * clock, void * data, size_t size)
+{
+	FILE * f;
+	bool ok;
+
+	// A single record, it belongs to the default clock
+	if (clock != &sysclock)
+		return false;
+	f = fopen(storage_path, "rb");
+	if (f == NULL)
+		return false;
+	ok = fread(data, 1, size, f) == size;
+	fclose(f);
+	return ok;
+}
+
+/**
+ * Writes a checkpoint record to a temporary file and moves it over the
+ * configured file
+ */
+static bool timelib_storage_file_write(struct timelib_clock * clock, const void * data, size_t size)
+{
+	char tmp[256];
+	FILE * f;
+	bool ok;
+
+	// A single record, it belongs to the default clock
+	if (clock != &sysclock)
+		return false;
+	if (strlen(storage_path) + 5 > sizeof(tmp))
+		return false;
+	strcpy(tmp, storage_path);
+	strcat(tmp, ".tmp");
+	f = fopen(tmp, "wb");
+	if (f == NULL)
+		return false;
+	ok = fwrite(data, 1, size, f) == size;
+	ok = (fclose(f) == 0) && ok;
+	if (ok)
+		ok = rename(tmp, storage_path) == 0;
+	if (!ok)
+		remove(tmp);
+	return ok;
+}
+
+void timelib_storage_file(const char * path, timelib_t interval)
+{
+	storage_path = path;
+	storage_file.read = timelib_storage_file_read;
+	storage_file.write = timelib_storage_file_write;
+	storage_file.interval = interval;
+	timelib_set_storage(&storage_file);
+}
+#elif defined(ARDUINO) && defined(__AVR__)
+/**
+ * Reads a checkpoint record from the EEPROM
+ */
+static bool timelib_storage_eeprom_read(struct timelib_clock * clock, void * data, size_t size)
+{
+	// A single record, it belongs to the default clock
+	if (clock != &sysclock)
+		return false;
+	eeprom_read_block(data, (const void *) storage_address, size);
+	return true;
+}
+
+/**
+ * Writes a checkpoint record to the EEPROM, unchanged bytes are not written
+ */
+static bool timelib_storage_eeprom_write(struct timelib_clock * clock, const void * data, size_t size)
+{
+	// A single record, it belongs to the default clock
+	if (clock != &sysclock)
+		return false;
+	eeprom_update_block(data, (void *) storage_address, size);
+	return true;
+}
+
+void timelib_storage_eeprom(uint16_t address, timelib_t interval)
+{
+	storage_address = address;
+	storage_eeprom.read = timelib_storage_eeprom_read;
+	storage_eeprom.write = timelib_storage_eeprom_write;
+	storage_eeprom.interval = interval;
+	timelib_set_storage(&storage_eeprom);
+}
+#endif
+#endif
+
+#if defined(CONFIG_TIMELIB_COARSE)
+void timelib_coarse_tick()
+{
+	unsigned long tick;
+	timelib_t now;
+	uint16_t ms = 0;
+
+	// Advance only, the provider is never called from the ticker context
+	tick = timelib_get_ticks();
+#if defined(CONFIG_TIMELIB_MONO)
+	// The ticker is the only context that extends the monotonic counter
+	timelib_mono_extend(tick);
+#endif
+	TIMELIB_TICKER_LOCK();
+	if (sysclock.halt == false)
+		ms = timelib_clock_advance(&sysclock, tick);
+	now = sysclock.time;
+	TIMELIB_TICKER_UNLOCK();
+
+	// Publish, readers retry while the sequence counter is odd or changes
+	timelib_atomic_store(&coarse_seq, coarse_seq + 1);
+	timelib_atomic_fence();
+	timelib_atomic_store(&coarse_time, now);
+	timelib_atomic_store(&coarse_ms, ms);
+	timelib_atomic_fence();
+	timelib_atomic_store(&coarse_seq, coarse_seq + 1);
+}
+
+timelib_t timelib_get_coarse()
+{
+#if defined(TIMELIB_ATOMIC_LOCK_FREE)
+	return timelib_atomic_load(&coarse_time);
+#else
+	uint16_t ms;
+
+	return timelib_get_coarse_ms(&ms);
+#endif
+}
+
+timelib_t timelib_get_coarse_ms(uint16_t * ms)
+{
+	unsigned int seq;
+	timelib_t now;
+
+	do {
+		seq = timelib_atomic_load(&coarse_seq);
+		timelib_atomic_fence();
+		now = timelib_atomic_load(&coarse_time);
+		*ms = timelib_atomic_load(&coarse_ms);
+		timelib_atomic_fence();
+	} while ((seq & 1) || seq != timelib_atomic_load(&coarse_seq));
+
+	return now;
+}
+
+#if defined(TIMELIB_PORT_POSIX)
+void timelib_port_mutex_lock()
+{
+	pthread_mutex_lock(&coarse_lock);
+}
+
+void timelib_port_mutex_unlock()
+{
+	pthread_mutex_unlock(&coarse_lock);
+}
+
+/**
+ * Body of the coarse clock background thread
+ *
+ * @param arg Not used
+ *
+ * @return Always returns NULL
+ */
+static void * timelib_coarse_worker(void * arg)
+{
+	struct timespec ts;
+
+	(void) arg;
+	ts.tv_sec = coarse_period / 1000;
+	ts.tv_nsec = (long) (coarse_period % 1000) * 1000000L;
+	while (timelib_atomic_load(&coarse_running)) {
+		timelib_coarse_tick();
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+
+bool timelib_coarse_start(unsigned long period)
+{
+	if (coarse_running || period == 0 || period > 1000)
+		return false;
+	coarse_period = period;
+	// Publish a valid value before readers get the chance to run
+	timelib_coarse_tick();
+	timelib_atomic_store(&coarse_running, true);
+	if (pthread_create(&coarse_thread, NULL, timelib_coarse_worker, NULL) != 0) {
+		timelib_atomic_store(&coarse_running, false);
+		return false;
+	}
+	return true;
+}
+
+void timelib_coarse_stop()
+{
+	if (!coarse_running)
+		return;
+	timelib_atomic_store(&coarse_running, false);
+	pthread_join(coarse_thread, NULL);
+}
+#endif
+#endif
+
+#if defined(CONFIG_TIMELIB_STATS)
+void timelib_stats_get(struct timelib_stats * stats)
+{
+	uint8_t i;
+
+	stats->get_calls = timelib_atomic_load(&tstats.get_calls);
+	stats->cache_hits = timelib_atomic_load(&tstats.cache_hits);
+	stats->cache_misses = timelib_atomic_load(&tstats.cache_misses);
+	stats->catchup_runs = timelib_atomic_load(&tstats.catchup_runs);
+	stats->catchup_seconds = timelib_atomic_load(&tstats.catchup_seconds);
+	stats->provider_calls = timelib_atomic_load(&tstats.provider_calls);
+	stats->provider_failures = timelib_atomic_load(&tstats.provider_failures);
+	stats->conversions = timelib_atomic_load(&tstats.conversions);
+	for (i = 0; i < CONFIG_TIMELIB_STATS_BUCKETS; i++) {
+		stats->provider_latency[i] = timelib_atomic_load(&tstats.provider_latency[i]);
+		stats->conversion_latency[i] = timelib_atomic_load(&tstats.conversion_latency[i]);
+	}
+}
+
+void timelib_stats_reset()
+{
+	uint8_t i;
+
+	timelib_atomic_store(&tstats.get_calls, 0);
+	timelib_atomic_store(&tstats.cache_hits, 0);
+	timelib_atomic_store(&tstats.cache_misses, 0);
+	timelib_atomic_store(&tstats.catchup_runs, 0);
+	timelib_atomic_store(&tstats.catchup_seconds, 0);
+	timelib_atomic_store(&tstats.provider_calls, 0);
+	timelib_atomic_store(&tstats.provider_failures, 0);
+	timelib_atomic_store(&tstats.conversions, 0);
+	for (i = 0; i < CONFIG_TIMELIB_STATS_BUCKETS; i++) {
+		timelib_atomic_store(&tstats.provider_latency[i], 0);
+		timelib_atomic_store(&tstats.conversion_latency[i], 0);
+	}
 }
+#endif
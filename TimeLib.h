@@ -41,6 +41,59 @@
  */
 //#define CONFIG_TIMELIB_LEGACY_API
 
+/**
+ * Enable the collection of runtime statistics: time cache hits and misses,
+ * seconds walked by the catch-up loop, provider results and latency histograms
+ * for provider calls and conversions. Comment it to remove all instrumentation
+ * code and data from the library.
+ */
+//#define CONFIG_TIMELIB_STATS
+
+/**
+ * Number of buckets on each latency histogram. Bucket 0 counts calls that took
+ * less than one clock unit, bucket n counts calls that took from 2^(n-1) to
+ * 2^n - 1 units and the last bucket counts every longer call.
+ */
+#define CONFIG_TIMELIB_STATS_BUCKETS	12
+
+/**
+ * First year that can be stored on a packed date/time value, expressed as an
+ * offset from 1970 like the tm_year field. Packed values cover 64 years
+ * starting on this year, by default from 2000 to 2063.
+ */
+#define CONFIG_TIMELIB_PACKED_BASE	30
+
+/**
+ * Enable clock checkpoints. The state of a clock (time, last sync, drift
+ * estimate and status) of the default clock is saved on a storage backend after
+ * each provider sync and can be restored after a reset, so the clock starts
+ * with an estimated time instead of zero while waiting for the first sync.
+ */
+//#define CONFIG_TIMELIB_CHECKPOINT
+
+/**
+ * Largest tick counter error in parts per million accepted by the drift
+ * estimate of the checkpoints. Syncs that show a larger error come from a
+ * provider that stepped or a clock that was set by other means, they restart
+ * the estimate instead of updating it.
+ */
+#define CONFIG_TIMELIB_DRIFT_MAX	10000L
+
+/**
+ * Enable the coarse clock. In this mode a single ticker (a periodic interrupt
+ * on microcontrollers or a background thread on POSIX systems) calls
+ * timelib_coarse_tick() and readers get the published time with
+ * timelib_get_coarse() without touching the tick counter or the sync logic.
+ */
+//#define CONFIG_TIMELIB_COARSE
+
+/**
+ * Enable the monotonic uptime clock, timelib_mono_us(). Every tick reading
+ * (or every coarse tick) extends a 64 bit counter, comment it to keep the tick
+ * reads of the library free of this work. The SNTP client needs it.
+ */
+//#define CONFIG_TIMELIB_MONO
+
 /*-------------------------------------------------------------*
  *		Macros and definitions				*
  *-------------------------------------------------------------*/
@@ -73,6 +126,16 @@ struct timelib_tm {
 	uint8_t tm_year; //!< Year offset from 1970;
 };
 
+/**
+ * @brief Date and time packed on a 32 bit integer
+ *
+ * Fields are stored from the most to the least significant bit: year offset
+ * from CONFIG_TIMELIB_PACKED_BASE (6 bits), month (4), day of month (5),
+ * hour (5), minute (6) and second (6). Packed values sort and compare as plain
+ * integers. Zero is never a valid date and marks conversion errors.
+ */
+typedef uint32_t timelib_packed_t;
+
 /**
  * @brief Enumeration defines the current state of the system time
  */
@@ -80,6 +143,7 @@ enum time_status {
 	E_TIME_NOT_SET = 0, //!< Time has not been set
 	E_TIME_NEEDS_SYNC, //!< Time was set, but needs to be synced with timebase
 	E_TIME_OK, //!< Time is valid and in sync with time source
+	E_TIME_RESTORED, //!< Time was estimated from a checkpoint, needs sync
 };
 
 /**
@@ -91,6 +155,95 @@ enum time_status {
  */
 typedef timelib_t(* timelib_callback_t)();
 
+/**
+ * @brief Type definition for the function pointer that reads the tick counter
+ *
+ * The returned value must increase TICK_SECOND times per second and may wrap
+ * around on overflow.
+ */
+typedef unsigned long(* timelib_tick_source_t)();
+
+struct timelib_clock;
+
+/**
+ * @brief Type definition for the provider callback of a clock instance
+ *
+ * Works like timelib_callback_t but receives the clock being synced, so a
+ * single function can serve many clocks. The clock structure can be embedded
+ * on a larger application structure to reach per instance data.
+ */
+typedef timelib_t(* timelib_clock_callback_t)(struct timelib_clock * clock);
+
+/**
+ * @brief State of an independent clock instance
+ *
+ * Every field is private to the library, use the timelib_clock_* functions to
+ * operate on a clock. The functions without a clock parameter operate on a
+ * default instance.
+ */
+struct timelib_clock {
+	timelib_t time; //!< Unix like time counter
+	timelib_t sync_interval; //!< Seconds between syncs with the provider
+	timelib_t sync_next; //!< Timestamp when the next sync should be done
+	unsigned long last_update; //!< Tick count of the last time update
+	timelib_clock_callback_t provider; //!< Precise time source, may be null
+	uint8_t status; //!< Status of the time, see enum time_status
+	bool halt; //!< Flag used to "freeze" the clock value
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+	timelib_t last_sync; //!< Timestamp of the last successful provider sync
+	timelib_t last_save; //!< Timestamp of the last checkpoint written
+	int32_t drift; //!< Estimated tick counter error in parts per million
+#endif
+};
+
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+/**
+ * @brief Clock state saved on a checkpoint
+ */
+struct timelib_checkpoint {
+	uint32_t magic; //!< Identifies a valid checkpoint, see TIMELIB_CHECKPOINT_MAGIC
+	timelib_t time; //!< Clock time when the checkpoint was written
+	timelib_t last_sync; //!< Timestamp of the last successful provider sync
+	int32_t drift; //!< Estimated tick counter error in parts per million
+	uint8_t status; //!< Status of the clock when the checkpoint was written
+	uint8_t checksum; //!< Makes the sum of all bytes of the record equal zero
+};
+
+/**
+ * @brief Storage backend for clock checkpoints
+ *
+ * The callbacks receive the clock being saved or restored so a backend can
+ * keep separate records for several clocks.
+ */
+struct timelib_storage {
+	bool(* read)(struct timelib_clock * clock, void * data, size_t size); //!< Reads a record, returns true on success
+	bool(* write)(struct timelib_clock * clock, const void * data, size_t size); //!< Writes a record, returns true on success
+	timelib_t interval; //!< Minimum seconds between writes that are not forced
+};
+#endif
+
+#if defined(CONFIG_TIMELIB_STATS)
+/**
+ * @brief Snapshot of the library runtime statistics
+ *
+ * Latencies are measured with TIMELIB_STATS_CLOCK(), which defaults to the
+ * port tick counter and can be overridden by the port with a finer clock
+ * (microseconds on Arduino).
+ */
+struct timelib_stats {
+	uint32_t get_calls; //!< Reads of any clock, halted or not, by any read function
+	uint32_t cache_hits; //!< Field queries served from the time cache
+	uint32_t cache_misses; //!< Field queries that had to break the timestamp
+	uint32_t catchup_runs; //!< Clock reads that advanced the clock by whole seconds
+	uint32_t catchup_seconds; //!< Seconds walked by the catch-up loop
+	uint32_t provider_calls; //!< Invocations of the provider callback
+	uint32_t provider_failures; //!< Provider calls that returned no time
+	uint32_t conversions; //!< Calls to timelib_make() and timelib_break()
+	uint32_t provider_latency[CONFIG_TIMELIB_STATS_BUCKETS]; //!< Provider call latency histogram
+	uint32_t conversion_latency[CONFIG_TIMELIB_STATS_BUCKETS]; //!< Conversion latency histogram
+};
+#endif
+
 /*-------------------------------------------------------------*
  *		Function prototypes				*
  *-------------------------------------------------------------*/
@@ -150,6 +303,22 @@ extern "C" {
 	 */
 	uint8_t timelib_get_status();
 
+	/**
+	 * @brief Gets the current time and its human readable components at once
+	 *
+	 * Reads the clock a single time, so the timestamp and every field of the
+	 * structure belong to the same second. Prefer this function over calling
+	 * timelib_hour(), timelib_minute(), etc. one after another, the time may
+	 * change between those calls.
+	 *
+	 * @param timeinfo Pointer to tm structure to store the current time
+	 * @param ms Pointer to store the milliseconds elapsed on the current
+	 * second, may be null
+	 *
+	 * @return The current Unix timestamp
+	 */
+	timelib_t timelib_now_tm(struct timelib_tm * timeinfo, uint16_t * ms);
+
 	/**
 	 * Compute the second at a given timestamp
 	 *
@@ -303,6 +472,368 @@ extern "C" {
 	 */
 	void timelib_set_provider(timelib_callback_t callback, timelib_t timespan);
 
+	/**
+	 * @brief Sets the tick counter that drives all the clocks
+	 *
+	 * By default clocks advance with the tick_get() function of the port. This
+	 * function replaces it at runtime, for example with a simulated time
+	 * source for tests. Clocks keep their time across the change only if the
+	 * new source continues from the same tick count.
+	 *
+	 * @param source The function that reads the tick counter, null to restore
+	 * the port tick counter
+	 */
+	void timelib_set_tick_source(timelib_tick_source_t source);
+
+	/**
+	 * @brief Reads the tick counter that drives the clocks
+	 *
+	 * @return The tick count of the configured tick source
+	 */
+	unsigned long timelib_get_ticks();
+
+#if defined(CONFIG_TIMELIB_MONO)
+	/**
+	 * @brief Gets the monotonic uptime clock
+	 *
+	 * The monotonic clock counts the ticks read from the tick source since
+	 * startup extended to 64 bits. Unlike the wall time it is never stepped
+	 * by timelib_set() or provider syncs, use it to measure intervals and
+	 * timeouts. The counter is extended by a single writer: the coarse ticker
+	 * when CONFIG_TIMELIB_COARSE is enabled, otherwise every tick reading of
+	 * the library, which must then be used from a single context. Tick
+	 * counter wrap arounds are handled as long as the writer runs at least
+	 * once per wrap period, about 49 days for a 32 bit millisecond counter.
+	 * Replaying or replacing the tick source breaks the monotonic count.
+	 *
+	 * @return Microseconds elapsed since startup, the resolution is that of
+	 * the tick counter
+	 */
+	uint64_t timelib_mono_us();
+
+	/**
+	 * @brief Estimates the wall time of a monotonic clock instant
+	 *
+	 * Uses the current offset between the default clock and the monotonic
+	 * clock, so the result reflects the latest sync.
+	 *
+	 * @param mono Monotonic instant returned by timelib_mono_us()
+	 * @param ms Pointer to store the milliseconds part, may be null
+	 *
+	 * @return The Unix timestamp for the given instant
+	 */
+	timelib_t timelib_mono_to_wall(uint64_t mono, uint16_t * ms);
+#endif
+
+	/**
+	 * @brief Initializes a clock instance
+	 *
+	 * The clock starts with time not set, no provider and a sync interval
+	 * of one day.
+	 *
+	 * @param clock Pointer to the clock to initialize
+	 */
+	void timelib_clock_init(struct timelib_clock * clock);
+
+	/**
+	 * @brief Sets the time of a clock instance
+	 *
+	 * The time set here did not come from the provider, so the drift estimate
+	 * starts a new span on the next provider sync.
+	 *
+	 * @param clock Pointer to the clock
+	 * @param now Unix timestamp to set
+	 */
+	void timelib_clock_set(struct timelib_clock * clock, timelib_t now);
+
+	/**
+	 * @brief Gets the time of a clock instance
+	 *
+	 * Syncs the clock with its provider when the sync interval has expired
+	 * and advances the time counter with the elapsed ticks.
+	 *
+	 * @param clock Pointer to the clock
+	 *
+	 * @return The Unix timestamp of the clock
+	 */
+	timelib_t timelib_clock_get(struct timelib_clock * clock);
+
+	/**
+	 * @brief Gets the time of a clock instance and its components at once
+	 *
+	 * @param clock Pointer to the clock
+	 * @param timeinfo Pointer to tm structure to store the current time
+	 * @param ms Pointer to store the milliseconds elapsed on the current
+	 * second, may be null
+	 *
+	 * @return The Unix timestamp of the clock
+	 */
+	timelib_t timelib_clock_now_tm(struct timelib_clock * clock, struct timelib_tm * timeinfo, uint16_t * ms);
+
+#if defined(CONFIG_TIMELIB_MONO)
+	/**
+	 * @brief Estimates the wall time of a monotonic instant on a clock instance
+	 *
+	 * @param clock Pointer to the clock
+	 * @param mono Monotonic instant returned by timelib_mono_us()
+	 * @param ms Pointer to store the milliseconds part, may be null
+	 *
+	 * @return The Unix timestamp for the given instant
+	 */
+	timelib_t timelib_clock_mono_to_wall(struct timelib_clock * clock, uint64_t mono, uint16_t * ms);
+#endif
+
+	/**
+	 * @brief Stops the time counter of a clock instance
+	 *
+	 * @param clock Pointer to the clock
+	 */
+	void timelib_clock_halt(struct timelib_clock * clock);
+
+	/**
+	 * @brief Resumes the time counter of a clock instance
+	 *
+	 * @param clock Pointer to the clock
+	 */
+	void timelib_clock_resume(struct timelib_clock * clock);
+
+	/**
+	 * @brief Gets the status of a clock instance
+	 *
+	 * @param clock Pointer to the clock
+	 *
+	 * @return Returns a code that determines the time status.
+	 */
+	uint8_t timelib_clock_get_status(struct timelib_clock * clock);
+
+	/**
+	 * @brief Sets the provider callback of a clock instance
+	 *
+	 * @param clock Pointer to the clock
+	 * @param callback The callback to get precise time information
+	 * @param timespan The interval in seconds when the callback should be called
+	 */
+	void timelib_clock_set_provider(struct timelib_clock * clock, timelib_clock_callback_t callback, timelib_t timespan);
+
+	/**
+	 * @brief Updates a group of clock instances at once
+	 *
+	 * Reads the tick counter once and runs the sync and update logic of
+	 * timelib_clock_get() on every clock of the array.
+	 *
+	 * @param clocks Array of clocks to update
+	 * @param count Number of clocks on the array
+	 */
+	void timelib_clock_advance_all(struct timelib_clock * clocks, size_t count);
+
+	/**
+	 * @brief Packs a Unix timestamp into a 32 bit date/time value
+	 *
+	 * This function runs in constant time, it does not loop over years or
+	 * months like timelib_break().
+	 *
+	 * @param time The timestamp to convert
+	 *
+	 * @return The packed date/time or TIMELIB_PACKED_INVALID if the year is
+	 * outside of the packed range
+	 */
+	timelib_packed_t timelib_pack(timelib_t time);
+
+	/**
+	 * @brief Converts a packed date/time value to a Unix timestamp
+	 *
+	 * @param packed The packed date/time to convert
+	 *
+	 * @return The Unix timestamp for the packed date/time
+	 */
+	timelib_t timelib_unpack(timelib_packed_t packed);
+
+	/**
+	 * @brief Packs the contents of a time structure
+	 *
+	 * @param timeinfo The time structure to convert, tm_wday is ignored
+	 *
+	 * @return The packed date/time or TIMELIB_PACKED_INVALID if the year is
+	 * outside of the packed range
+	 */
+	timelib_packed_t timelib_pack_tm(const struct timelib_tm * timeinfo);
+
+	/**
+	 * @brief Expands a packed date/time value into a time structure
+	 *
+	 * @param packed The packed date/time to convert
+	 * @param timeinfo Pointer to tm structure to store the resulting time
+	 */
+	void timelib_unpack_tm(timelib_packed_t packed, struct timelib_tm * timeinfo);
+
+	/**
+	 * @brief Packs an array of Unix timestamps
+	 *
+	 * @param times Array of timestamps to convert
+	 * @param packed Array that receives the packed values
+	 * @param count Number of elements on both arrays
+	 */
+	void timelib_pack_array(const timelib_t * times, timelib_packed_t * packed, size_t count);
+
+	/**
+	 * @brief Converts an array of packed date/time values to Unix timestamps
+	 *
+	 * @param packed Array of packed values to convert
+	 * @param times Array that receives the timestamps
+	 * @param count Number of elements on both arrays
+	 */
+	void timelib_unpack_array(const timelib_packed_t * packed, timelib_t * times, size_t count);
+
+#if defined(CONFIG_TIMELIB_CHECKPOINT)
+	/**
+	 * @brief Sets the backend where checkpoints are stored
+	 *
+	 * @param storage Pointer to the backend, must remain valid while in use,
+	 * null disables checkpoints
+	 */
+	void timelib_set_storage(const struct timelib_storage * storage);
+
+	/**
+	 * @brief Saves the state of a clock on the storage backend
+	 *
+	 * Checkpoints of the default clock are written automatically after each
+	 * successful provider sync, other clocks are saved only when this
+	 * function is called and need a backend that keeps a record per clock
+	 * (the built in backends only store the default clock). To spare flash
+	 * wear, writes that are not forced are skipped until the storage
+	 * interval has elapsed since the last one.
+	 *
+	 * @param clock Pointer to the clock
+	 * @param force Write even if the storage interval has not elapsed
+	 *
+	 * @return Returns true if the checkpoint was written
+	 */
+	bool timelib_clock_checkpoint(struct timelib_clock * clock, bool force);
+
+	/**
+	 * @brief Restores the state of a clock from the storage backend
+	 *
+	 * On success the clock runs from the saved time, corrected with the drift
+	 * estimate for the span between the last sync and the checkpoint, with
+	 * status E_TIME_RESTORED and syncs with its provider on the next read.
+	 *
+	 * @param clock Pointer to the clock
+	 *
+	 * @return Returns true if a valid checkpoint was found
+	 */
+	bool timelib_clock_restore(struct timelib_clock * clock);
+
+	/**
+	 * @brief Saves the state of the default clock, see timelib_clock_checkpoint()
+	 *
+	 * @param force Write even if the storage interval has not elapsed
+	 *
+	 * @return Returns true if the checkpoint was written
+	 */
+	bool timelib_checkpoint(bool force);
+
+	/**
+	 * @brief Restores the state of the default clock, see timelib_clock_restore()
+	 *
+	 * @return Returns true if a valid checkpoint was found
+	 */
+	bool timelib_restore();
+
+#if defined(TIMELIB_PORT_POSIX)
+	/**
+	 * @brief Stores checkpoints of the default clock on a file
+	 *
+	 * The file is replaced atomically on each write.
+	 *
+	 * @param path Path of the file, must remain valid while in use
+	 * @param interval Minimum seconds between writes that are not forced
+	 */
+	void timelib_storage_file(const char * path, timelib_t interval);
+#endif
+
+#if defined(ARDUINO) && defined(__AVR__)
+	/**
+	 * @brief Stores checkpoints of the default clock on the internal EEPROM
+	 *
+	 * Only the bytes that changed are written to the EEPROM.
+	 *
+	 * @param address EEPROM address of the checkpoint record
+	 * @param interval Minimum seconds between writes that are not forced
+	 */
+	void timelib_storage_eeprom(uint16_t address, timelib_t interval);
+#endif
+#endif
+
+#if defined(CONFIG_TIMELIB_COARSE)
+	/**
+	 * @brief Advances the coarse clock
+	 *
+	 * This function advances the default clock and publishes the result for
+	 * coarse readers. It should be called from a single context at least once
+	 * per second, calling it more often improves the resolution of the
+	 * sub-second part. The provider is never called from here, so the ticker
+	 * can run from an interrupt: keep calling timelib_get() or timelib_now_tm()
+	 * from the application context to let the clock sync. Those functions
+	 * lock the default clock while they touch it (a mutex on POSIX systems,
+	 * masking interrupts on microcontrollers) and release it while the
+	 * provider runs.
+	 */
+	void timelib_coarse_tick();
+
+	/**
+	 * @brief Gets the time published by the coarse clock
+	 *
+	 * This function is safe to call from any thread or interrupt context and
+	 * costs a single atomic load on targets with lock free 32 bit operations.
+	 *
+	 * @return The Unix timestamp published by the last coarse tick
+	 */
+	timelib_t timelib_get_coarse();
+
+	/**
+	 * @brief Gets the time published by the coarse clock with sub-second part
+	 *
+	 * @param ms Pointer to store the milliseconds elapsed on the returned second
+	 *
+	 * @return The Unix timestamp published by the last coarse tick
+	 */
+	timelib_t timelib_get_coarse_ms(uint16_t * ms);
+
+#if defined(TIMELIB_PORT_POSIX)
+	/**
+	 * @brief Starts a background thread that drives the coarse clock
+	 *
+	 * @param period Interval in milliseconds between coarse clock updates
+	 *
+	 * @return Returns true if the thread was started, false otherwise
+	 */
+	bool timelib_coarse_start(unsigned long period);
+
+	/**
+	 * @brief Stops the coarse clock background thread
+	 */
+	void timelib_coarse_stop();
+#endif
+#endif
+
+#if defined(CONFIG_TIMELIB_STATS)
+	/**
+	 * @brief Takes a snapshot of the runtime statistics
+	 *
+	 * Copies the current value of every counter to the given structure. Each
+	 * counter is read atomically but the snapshot as a whole is not, counters
+	 * may advance while the copy is being made.
+	 *
+	 * @param stats Pointer to the structure that receives the counters
+	 */
+	void timelib_stats_get(struct timelib_stats * stats);
+
+	/**
+	 * @brief Clears all the runtime statistics counters
+	 */
+	void timelib_stats_reset();
+#endif
+
 #ifdef	__cplusplus
 }
 #endif
@@ -420,6 +951,51 @@ extern "C" {
  */
 #define timelib_next_sunday(t)		(timelib_prev_sunday(t)+TIMELIB_SECS_PER_WEEK)
 
+/**
+ * Value returned when a date/time cannot be packed
+ */
+#define TIMELIB_PACKED_INVALID		(0UL)
+
+/**
+ * Identifies a valid checkpoint record
+ */
+#define TIMELIB_CHECKPOINT_MAGIC	(0x544C4301UL)
+
+/**
+ * Extracts the year (offset from 1970 like tm_year) from a packed value
+ */
+#define timelib_packed_year(p)		((uint8_t)(((p) >> 26) & 0x3F) + CONFIG_TIMELIB_PACKED_BASE)
+
+/**
+ * Extracts the month (1-12) from a packed value
+ */
+#define timelib_packed_month(p)		((uint8_t)(((p) >> 22) & 0x0F))
+
+/**
+ * Extracts the day of the month (1-31) from a packed value
+ */
+#define timelib_packed_day(p)		((uint8_t)(((p) >> 17) & 0x1F))
+
+/**
+ * Extracts the hour from a packed value
+ */
+#define timelib_packed_hour(p)		((uint8_t)(((p) >> 12) & 0x1F))
+
+/**
+ * Extracts the minute from a packed value
+ */
+#define timelib_packed_minute(p)	((uint8_t)(((p) >> 6) & 0x3F))
+
+/**
+ * Extracts the second from a packed value
+ */
+#define timelib_packed_second(p)	((uint8_t)((p) & 0x3F))
+
+/**
+ * Extracts the date part of a packed value, useful to compare dates only
+ */
+#define timelib_packed_date(p)		((p) & 0xFFFE0000UL)
+
 /*-------------------------------------------------------------*
  *		Legacy API macros				*
  *-------------------------------------------------------------*/
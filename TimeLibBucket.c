@@ -0,0 +1,196 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/* POSIX declarations on hosted builds, must come before any system header */
+#if (defined( __unix__ ) || defined( __APPLE__ )) && !defined( _POSIX_C_SOURCE )
+#define _POSIX_C_SOURCE		200809L
+#endif
+
+#include "TimeLibBucket.h"
+#include "TimeLibCivil.h"
+
+#if defined(TIMELIB_PORT_POSIX)
+#include <pthread.h>
+#include <stdlib.h>
+#endif
+
+/* Number of elements converted at once when counting */
+#define TIMELIB_BUCKET_CHUNK		64
+
+/*
+ * GCC only vectorizes divisions by a constant with the cost model of -O3,
+ * request it for the index kernels. Size optimized builds (-Os, the Arduino
+ * default) keep the scalar loops.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__OPTIMIZE_SIZE__)
+#define TIMELIB_BUCKET_VECTORIZE	__attribute__((optimize("tree-vectorize")))
+#else
+#define TIMELIB_BUCKET_VECTORIZE
+#endif
+
+/**
+ * Computes the months elapsed since January 1970 for the given day count
+ *
+ * @param days Days elapsed since Jan 1, 1970
+ *
+ * @return Months elapsed since January 1970
+ */
+static inline uint32_t timelib_bucket_month(uint32_t days)
+{
+	uint32_t year;
+	uint8_t month, day;
+
+	timelib_civil_from_days(days, &year, &month, &day);
+	return(year - 1970) * 12 + month - 1;
+}
+
+TIMELIB_BUCKET_VECTORIZE
+void timelib_bucket_index(const timelib_t * restrict times, uint32_t * restrict index, size_t count, enum timelib_bucket_unit unit, int32_t offset)
+{
+	const uint32_t hour = TIMELIB_SECS_PER_HOUR, day = TIMELIB_SECS_PER_DAY, week = TIMELIB_DAYS_PER_WEEK;
+	uint32_t off = (uint32_t) offset;
+	size_t i;
+
+	// One simple loop per unit on 32 bit lanes, the restrict qualifiers spare
+	// the compiler the runtime alias checks
+	switch (unit) {
+	case E_TIMELIB_BUCKET_HOUR:
+		for (i = 0; i < count; i++)
+			index[i] = (times[i] + off) / hour;
+		break;
+	case E_TIMELIB_BUCKET_DAY:
+		for (i = 0; i < count; i++)
+			index[i] = (times[i] + off) / day;
+		break;
+	case E_TIMELIB_BUCKET_WEEK:
+		// Jan 1, 1970 was thursday, three days after the start of its week
+		for (i = 0; i < count; i++)
+			index[i] = ((times[i] + off) / day + 3) / week;
+		break;
+	case E_TIMELIB_BUCKET_MONTH:
+		for (i = 0; i < count; i++)
+			index[i] = timelib_bucket_month((times[i] + off) / day);
+		break;
+	}
+}
+
+size_t timelib_bucket_count(const timelib_t * times, size_t count, enum timelib_bucket_unit unit, int32_t offset, uint32_t first, uint32_t * counts, size_t buckets)
+{
+	uint32_t index[TIMELIB_BUCKET_CHUNK];
+	uint32_t b;
+	size_t i, n, total = 0;
+
+	while (count != 0) {
+		n = (count < TIMELIB_BUCKET_CHUNK) ? count : TIMELIB_BUCKET_CHUNK;
+		timelib_bucket_index(times, index, n, unit, offset);
+		for (i = 0; i < n; i++) {
+			// Indexes below the first bucket wrap around to large values
+			b = index[i] - first;
+			if (b < buckets) {
+				counts[b]++;
+				total++;
+			}
+		}
+		times += n;
+		count -= n;
+	}
+	return total;
+}
+
+#if defined(TIMELIB_PORT_POSIX)
+/**
+ * Work assigned to each thread on a parallel count
+ */
+struct timelib_bucket_job {
+	pthread_t thread;
+	const timelib_t * times;
+	size_t count;
+	enum timelib_bucket_unit unit;
+	int32_t offset;
+	uint32_t first;
+	uint32_t * counts;
+	size_t buckets;
+	size_t total;
+};
+
+/**
+ * Body of each thread on a parallel count
+ *
+ * @param arg Pointer to the job structure
+ *
+ * @return Always returns NULL
+ */
+static void * timelib_bucket_worker(void * arg)
+{
+	struct timelib_bucket_job * job = (struct timelib_bucket_job *) arg;
+
+	job->total = timelib_bucket_count(job->times, job->count, job->unit, job->offset, job->first, job->counts, job->buckets);
+	return NULL;
+}
+
+size_t timelib_bucket_count_parallel(const timelib_t * times, size_t count, enum timelib_bucket_unit unit, int32_t offset, uint32_t first, uint32_t * counts, size_t buckets, unsigned int threads)
+{
+	struct timelib_bucket_job jobs[CONFIG_TIMELIB_BUCKET_THREADS];
+	uint32_t * hist;
+	size_t i, total = 0, chunk;
+	unsigned int t, started;
+
+	if (threads > CONFIG_TIMELIB_BUCKET_THREADS)
+		threads = CONFIG_TIMELIB_BUCKET_THREADS;
+	if (threads <= 1 || count < threads * TIMELIB_BUCKET_CHUNK)
+		return timelib_bucket_count(times, count, unit, offset, first, counts, buckets);
+
+	// Private histograms avoid sharing counters between threads
+	hist = (uint32_t *) calloc((size_t) threads * buckets, sizeof(uint32_t));
+	if (hist == NULL)
+		return timelib_bucket_count(times, count, unit, offset, first, counts, buckets);
+
+	chunk = (count + threads - 1) / threads;
+	for (t = 0; t < threads; t++) {
+		jobs[t].times = times + t * chunk;
+		jobs[t].count = (t == threads - 1) ? count - t * chunk : chunk;
+		jobs[t].unit = unit;
+		jobs[t].offset = offset;
+		jobs[t].first = first;
+		jobs[t].counts = hist + t * buckets;
+		jobs[t].buckets = buckets;
+		jobs[t].total = 0;
+	}
+
+	// The calling thread takes the first job
+	for (started = 1; started < threads; started++)
+		if (pthread_create(&jobs[started].thread, NULL, timelib_bucket_worker, &jobs[started]) != 0)
+			break;
+	timelib_bucket_worker(&jobs[0]);
+	for (t = 1; t < threads; t++) {
+		if (t < started)
+			pthread_join(jobs[t].thread, NULL);
+		else
+			timelib_bucket_worker(&jobs[t]);
+	}
+
+	for (t = 0; t < threads; t++) {
+		for (i = 0; i < buckets; i++)
+			counts[i] += jobs[t].counts[i];
+		total += jobs[t].total;
+	}
+	free(hist);
+	return total;
+}
+#endif
@@ -0,0 +1,109 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBBUCKET_H
+#define TIMELIBBUCKET_H
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include "TimeLib.h"
+
+/*-------------------------------------------------------------*
+ *		Library configuration				*
+ *-------------------------------------------------------------*/
+
+/**
+ * Maximum number of threads used by timelib_bucket_count_parallel()
+ */
+#define CONFIG_TIMELIB_BUCKET_THREADS	16
+
+/*-------------------------------------------------------------*
+ *		Typedefs enums & structs			*
+ *-------------------------------------------------------------*/
+
+/**
+ * @brief Calendar granularity used to group timestamps
+ *
+ * Bucket indexes count whole units elapsed since 00:00 hours, Jan 1, 1970 on
+ * the local time given by the offset. Weeks follow ISO 8601 and start on
+ * Monday, week 0 starts on Monday Dec 29, 1969.
+ */
+enum timelib_bucket_unit {
+	E_TIMELIB_BUCKET_HOUR = 0, //!< Hours since the epoch
+	E_TIMELIB_BUCKET_DAY, //!< Days since the epoch
+	E_TIMELIB_BUCKET_WEEK, //!< ISO weeks since the epoch
+	E_TIMELIB_BUCKET_MONTH, //!< Months since January 1970
+};
+
+/*-------------------------------------------------------------*
+ *		Function prototypes				*
+ *-------------------------------------------------------------*/
+#ifdef	__cplusplus
+extern "C" {
+#endif
+	/**
+	 * @brief Maps timestamps to calendar bucket indexes
+	 *
+	 * @param times Array of timestamps to convert
+	 * @param index Array that receives the bucket index of each timestamp
+	 * @param count Number of elements on both arrays
+	 * @param unit Calendar granularity of the buckets
+	 * @param offset Time zone offset in seconds added to each timestamp
+	 */
+	void timelib_bucket_index(const timelib_t * times, uint32_t * index, size_t count, enum timelib_bucket_unit unit, int32_t offset);
+
+	/**
+	 * @brief Counts timestamps on consecutive calendar buckets
+	 *
+	 * Timestamps that fall outside the requested buckets are ignored, counts
+	 * are added to the values already present on the counts array.
+	 *
+	 * @param times Array of timestamps to count
+	 * @param count Number of timestamps
+	 * @param unit Calendar granularity of the buckets
+	 * @param offset Time zone offset in seconds added to each timestamp
+	 * @param first Index of the bucket stored on counts[0]
+	 * @param counts Array that accumulates the number of timestamps per bucket
+	 * @param buckets Number of elements of the counts array
+	 *
+	 * @return The number of timestamps that were counted
+	 */
+	size_t timelib_bucket_count(const timelib_t * times, size_t count, enum timelib_bucket_unit unit, int32_t offset, uint32_t first, uint32_t * counts, size_t buckets);
+
+#if defined(TIMELIB_PORT_POSIX)
+	/**
+	 * @brief Counts timestamps on consecutive calendar buckets using threads
+	 *
+	 * Works like timelib_bucket_count() splitting the input among several
+	 * threads, each one with a private histogram.
+	 *
+	 * @param threads Number of threads to use (1 - CONFIG_TIMELIB_BUCKET_THREADS)
+	 *
+	 * @return The number of timestamps that were counted
+	 */
+	size_t timelib_bucket_count_parallel(const timelib_t * times, size_t count, enum timelib_bucket_unit unit, int32_t offset, uint32_t first, uint32_t * counts, size_t buckets, unsigned int threads);
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
+// End of Header file
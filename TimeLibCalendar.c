@@ -0,0 +1,321 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#include "TimeLibCalendar.h"
+
+#if defined(__GNUC__)
+#define timelib_popcount(x)	((uint8_t) __builtin_popcountl(x))
+#else
+/**
+ * Counts the bits set on a 32 bit word
+ *
+ * @param x The word
+ *
+ * @return The number of bits set
+ */
+static uint8_t timelib_popcount(uint32_t x)
+{
+	x = x - ((x >> 1) & 0x55555555UL);
+	x = (x & 0x33333333UL) + ((x >> 2) & 0x33333333UL);
+	x = (x + (x >> 4)) & 0x0F0F0F0FUL;
+	return(uint8_t) ((x * 0x01010101UL) >> 24);
+}
+#endif
+
+/**
+ * Computes if the given year is a leap year
+ *
+ * @param year The calendar year
+ *
+ * @return Returns true if "year" is leap, false otherwise
+ */
+static bool timelib_calendar_leap(uint16_t year)
+{
+	return((year % 4 == 0 && year % 100 != 0) || year % 400 == 0);
+}
+
+/**
+ * Counts business days from the epoch to the given day using only the weekend
+ * mask
+ *
+ * @param cal Pointer to the calendar
+ * @param day Days elapsed since the epoch
+ *
+ * @return Business days before the given day
+ */
+static uint32_t timelib_calendar_weeks(const struct timelib_calendar * cal, uint32_t day)
+{
+	return(day / 7) * cal->week[7] + cal->week[day % 7];
+}
+
+/**
+ * Finds the business day with the given index using only the weekend mask
+ *
+ * @param cal Pointer to the calendar
+ * @param index Number of business days before the wanted day
+ *
+ * @return Days from the epoch to the wanted day
+ */
+static uint32_t timelib_calendar_weeks_select(const struct timelib_calendar * cal, uint32_t index)
+{
+	uint8_t j;
+
+	// No business days at all
+	if (cal->week[7] == 0)
+		return 0;
+	for (j = 0; cal->week[j + 1] <= index % cal->week[7]; j++);
+	return(index / cal->week[7]) * 7 + j;
+}
+
+/**
+ * Finds the covered year that contains the given day
+ *
+ * @param cal Pointer to the calendar
+ * @param day Days elapsed since the epoch
+ *
+ * @return Index of the year or cal->count if the day is not covered
+ */
+static uint8_t timelib_calendar_year(const struct timelib_calendar * cal, uint32_t day)
+{
+	uint32_t i;
+
+	if (cal->count == 0 || day < cal->years[0].first || day >= cal->end)
+		return cal->count;
+	// Estimate and correct, years are 365 or 366 days long
+	i = (day - cal->years[0].first) / 366;
+	while (i + 1 < cal->count && cal->years[i + 1].first <= day)
+		i++;
+	return(uint8_t) i;
+}
+
+/**
+ * Counts business days from the epoch to the given day
+ *
+ * @param cal Pointer to the calendar
+ * @param day Days elapsed since the epoch
+ *
+ * @return Business days before the given day
+ */
+static uint32_t timelib_calendar_rank(const struct timelib_calendar * cal, uint32_t day)
+{
+	const struct timelib_calendar_year * y;
+	uint32_t rank;
+	uint16_t doy;
+	uint8_t i, w;
+
+	i = timelib_calendar_year(cal, day);
+	if (i == cal->count) {
+		if (cal->count == 0 || day < cal->years[0].first)
+			return timelib_calendar_weeks(cal, day);
+		// After the covered years only the weekend counts
+		return cal->total + timelib_calendar_weeks(cal, day) - timelib_calendar_weeks(cal, cal->end);
+	}
+	y = &cal->years[i];
+	doy = (uint16_t) (day - y->first);
+	rank = y->before;
+	for (w = 0; w < doy / 32; w++)
+		rank += timelib_popcount(y->work[w]);
+	if (doy % 32 != 0)
+		rank += timelib_popcount(y->work[w] & ((1UL << (doy % 32)) - 1));
+	return rank;
+}
+
+/**
+ * Finds the business day with the given index
+ *
+ * @param cal Pointer to the calendar
+ * @param index Number of business days before the wanted day
+ *
+ * @return Days from the epoch to the wanted day
+ */
+static uint32_t timelib_calendar_select(const struct timelib_calendar * cal, uint32_t index)
+{
+	const struct timelib_calendar_year * y;
+	uint32_t word;
+	uint8_t lo, hi, mid, w, c;
+
+	if (cal->count == 0 || index < cal->years[0].before)
+		return timelib_calendar_weeks_select(cal, index);
+	if (index >= cal->total)
+		return timelib_calendar_weeks_select(cal, index - cal->total + timelib_calendar_weeks(cal, cal->end));
+
+	// Last year with no more business days before it than the index
+	lo = 0;
+	hi = cal->count - 1;
+	while (lo < hi) {
+		mid = (uint8_t) ((lo + hi + 1) / 2);
+		if (cal->years[mid].before <= index)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	y = &cal->years[lo];
+	index -= y->before;
+	for (w = 0; w < 12; w++) {
+		c = timelib_popcount(y->work[w]);
+		if (index < c)
+			break;
+		index -= c;
+	}
+	// Clear the lower bits set until the wanted one is the lowest
+	word = y->work[w];
+	while (index-- != 0)
+		word &= word - 1;
+	for (c = 0; (word & 1) == 0; c++)
+		word >>= 1;
+	return(uint32_t) y->first + w * 32 + c;
+}
+
+/**
+ * Recomputes the business days before each year starting on the given one
+ *
+ * @param cal Pointer to the calendar
+ * @param from Index of the first year to update
+ */
+static void timelib_calendar_sum(struct timelib_calendar * cal, uint8_t from)
+{
+	uint32_t total;
+	uint8_t i, w;
+
+	total = (from == 0) ? timelib_calendar_weeks(cal, cal->years[0].first) : cal->years[from].before;
+	for (i = from; i < cal->count; i++) {
+		cal->years[i].before = total;
+		for (w = 0; w < 12; w++)
+			total += timelib_popcount(cal->years[i].work[w]);
+	}
+	cal->total = total;
+}
+
+/**
+ * Updates the business day bit of a day without updating year counts
+ *
+ * @param cal Pointer to the calendar
+ * @param time Any timestamp of the day
+ * @param holiday True to clear the business day bit
+ *
+ * @return Index of the year that contains the day or cal->count if the day is
+ * not covered
+ */
+static uint8_t timelib_calendar_mark(struct timelib_calendar * cal, timelib_t time, bool holiday)
+{
+	uint32_t day;
+	uint16_t doy;
+	uint8_t i;
+
+	day = time / TIMELIB_SECS_PER_DAY;
+	i = timelib_calendar_year(cal, day);
+	if (i == cal->count)
+		return i;
+	doy = (uint16_t) (day - cal->years[i].first);
+	if (holiday)
+		cal->years[i].work[doy / 32] &= ~(1UL << (doy % 32));
+	else if ((cal->weekend & (1 << ((day + 4) % 7))) == 0)
+		cal->years[i].work[doy / 32] |= 1UL << (doy % 32);
+	return i;
+}
+
+/*-------------------------------------------------------------*
+ *	Public API, check TimeLibCalendar.h for documentation	*
+ *-------------------------------------------------------------*/
+void timelib_calendar_init(struct timelib_calendar * cal, struct timelib_calendar_year * years, uint8_t count, uint8_t first, uint8_t weekend)
+{
+	uint32_t day = 0;
+	uint16_t year, length, d;
+	uint8_t i, j;
+
+	cal->years = years;
+	cal->count = count;
+	cal->weekend = weekend & 0x7F;
+
+	// Business days on the first j days of a week, the epoch was a thursday
+	cal->week[0] = 0;
+	for (j = 0; j < 7; j++)
+		cal->week[j + 1] = cal->week[j] + (((cal->weekend >> ((j + 4) % 7)) & 1) ? 0 : 1);
+
+	// Days from the epoch to the first covered year
+	for (year = 1970; year < 1970 + first; year++)
+		day += timelib_calendar_leap(year) ? 366 : 365;
+
+	for (i = 0; i < count; i++, year++) {
+		length = timelib_calendar_leap(year) ? 366 : 365;
+		years[i].first = (uint16_t) day;
+		for (j = 0; j < 12; j++)
+			years[i].work[j] = 0;
+		for (d = 0; d < length; d++) {
+			if ((cal->weekend & (1 << ((day + d + 4) % 7))) == 0)
+				years[i].work[d / 32] |= 1UL << (d % 32);
+		}
+		day += length;
+	}
+	cal->end = (uint16_t) day;
+	cal->total = 0;
+	if (count != 0)
+		timelib_calendar_sum(cal, 0);
+}
+
+bool timelib_calendar_set_holiday(struct timelib_calendar * cal, timelib_t time, bool holiday)
+{
+	uint8_t i;
+
+	i = timelib_calendar_mark(cal, time, holiday);
+	if (i == cal->count)
+		return false;
+	timelib_calendar_sum(cal, i);
+	return true;
+}
+
+void timelib_calendar_set_holidays(struct timelib_calendar * cal, const timelib_t * times, size_t count)
+{
+	size_t n;
+
+	for (n = 0; n < count; n++)
+		timelib_calendar_mark(cal, times[n], true);
+	if (cal->count != 0)
+		timelib_calendar_sum(cal, 0);
+}
+
+bool timelib_calendar_is_business(const struct timelib_calendar * cal, timelib_t time)
+{
+	uint32_t day;
+
+	day = time / TIMELIB_SECS_PER_DAY;
+	return timelib_calendar_rank(cal, day + 1) != timelib_calendar_rank(cal, day);
+}
+
+int32_t timelib_calendar_count(const struct timelib_calendar * cal, timelib_t from, timelib_t to)
+{
+	return(int32_t) (timelib_calendar_rank(cal, to / TIMELIB_SECS_PER_DAY) - timelib_calendar_rank(cal, from / TIMELIB_SECS_PER_DAY));
+}
+
+timelib_t timelib_calendar_add(const struct timelib_calendar * cal, timelib_t time, int32_t n)
+{
+	uint32_t rank, last;
+
+	rank = timelib_calendar_rank(cal, time / TIMELIB_SECS_PER_DAY);
+	// Do not move before the first business day after the epoch
+	if (n < 0 && (uint32_t) (-n) > rank)
+		rank = 0;
+	else
+		rank += (uint32_t) n;
+	// Nor after the last one where this time of the day fits on a timelib_t
+	last = timelib_calendar_rank(cal, (0xFFFFFFFFUL - time % TIMELIB_SECS_PER_DAY) / TIMELIB_SECS_PER_DAY + 1);
+	if (last != 0 && rank >= last)
+		rank = last - 1;
+	return timelib_calendar_select(cal, rank) * TIMELIB_SECS_PER_DAY + time % TIMELIB_SECS_PER_DAY;
+}
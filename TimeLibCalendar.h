@@ -0,0 +1,162 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBCALENDAR_H
+#define TIMELIBCALENDAR_H
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include "TimeLib.h"
+
+/*-------------------------------------------------------------*
+ *		Macros and definitions				*
+ *-------------------------------------------------------------*/
+/**
+ * Weekend mask for saturday and sunday. Bit n of a weekend mask stands for
+ * the day of the week n + 1 (sunday is bit 0, saturday is bit 6).
+ */
+#define TIMELIB_WEEKEND_SAT_SUN		(0x41)
+
+/**
+ * Weekend mask for friday and saturday
+ */
+#define TIMELIB_WEEKEND_FRI_SAT		(0x60)
+
+/*-------------------------------------------------------------*
+ *		Typedefs enums & structs			*
+ *-------------------------------------------------------------*/
+
+/**
+ * @brief Business days of one calendar year
+ */
+struct timelib_calendar_year {
+	uint32_t work[12]; //!< Bit n is set if day n of the year is a business day
+	uint32_t before; //!< Business days from the epoch to the start of the year
+	uint16_t first; //!< Days from the epoch to Jan 1st of the year
+};
+
+/**
+ * @brief Business day calendar
+ *
+ * Covers a range of consecutive years with a bitmap of business days for
+ * each one. Days outside of the range only follow the weekend mask.
+ */
+struct timelib_calendar {
+	struct timelib_calendar_year * years; //!< Storage for the covered years
+	uint32_t total; //!< Business days from the epoch to the end of the covered years
+	uint16_t end; //!< Days from the epoch to the end of the covered years
+	uint8_t count; //!< Number of covered years
+	uint8_t weekend; //!< Mask of non working days of the week
+	uint8_t week[8]; //!< Business days on the first n days of a week starting on thursday
+};
+
+/*-------------------------------------------------------------*
+ *		Function prototypes				*
+ *-------------------------------------------------------------*/
+#ifdef	__cplusplus
+extern "C" {
+#endif
+	/**
+	 * @brief Prepares a business day calendar
+	 *
+	 * All the days of the covered years that are not on the weekend start as
+	 * business days.
+	 *
+	 * @param cal Pointer to the calendar
+	 * @param years Storage for the covered years, must remain valid while the
+	 * calendar is used
+	 * @param count Number of elements on the years array
+	 * @param first First covered year, as an offset from 1970 like tm_year
+	 * @param weekend Mask of non working days of the week
+	 */
+	void timelib_calendar_init(struct timelib_calendar * cal, struct timelib_calendar_year * years, uint8_t count, uint8_t first, uint8_t weekend);
+
+	/**
+	 * @brief Marks the day that contains the given time as a holiday
+	 *
+	 * @param cal Pointer to the calendar
+	 * @param time Any timestamp of the day
+	 * @param holiday True to make the day a holiday, false to make it a
+	 * business day again (weekends are never business days)
+	 *
+	 * @return Returns false if the day is outside of the covered years
+	 */
+	bool timelib_calendar_set_holiday(struct timelib_calendar * cal, timelib_t time, bool holiday);
+
+	/**
+	 * @brief Marks several days as holidays
+	 *
+	 * Faster than calling timelib_calendar_set_holiday() for each day.
+	 *
+	 * @param cal Pointer to the calendar
+	 * @param times Array with a timestamp of each holiday
+	 * @param count Number of elements on the array
+	 */
+	void timelib_calendar_set_holidays(struct timelib_calendar * cal, const timelib_t * times, size_t count);
+
+	/**
+	 * @brief Checks if the day that contains the given time is a business day
+	 *
+	 * @param cal Pointer to the calendar
+	 * @param time The timestamp to check
+	 *
+	 * @return Returns true on business days
+	 */
+	bool timelib_calendar_is_business(const struct timelib_calendar * cal, timelib_t time);
+
+	/**
+	 * @brief Counts business days between two timestamps
+	 *
+	 * Counts the business days from the day of the first timestamp (included)
+	 * to the day of the second (excluded) without iterating over days.
+	 *
+	 * @param cal Pointer to the calendar
+	 * @param from Start timestamp
+	 * @param to End timestamp
+	 *
+	 * @return The number of business days, negative if to is before from
+	 */
+	int32_t timelib_calendar_count(const struct timelib_calendar * cal, timelib_t from, timelib_t to);
+
+	/**
+	 * @brief Adds business days to a timestamp
+	 *
+	 * The result is the n-th business day after the day of the given
+	 * timestamp (before it if n is negative) at the same time of the day.
+	 * A start day that is not a business day is first moved to the next
+	 * business day, so adding zero days only performs this move.
+	 *
+	 * Results saturate to the first business day after the epoch and to the
+	 * last one that fits on a timelib_t, in February 2106.
+	 *
+	 * @param cal Pointer to the calendar
+	 * @param time Start timestamp
+	 * @param n Number of business days to add
+	 *
+	 * @return The resulting timestamp
+	 */
+	timelib_t timelib_calendar_add(const struct timelib_calendar * cal, timelib_t time, int32_t n);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
+// End of Header file
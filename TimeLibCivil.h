@@ -0,0 +1,86 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBCIVIL_H
+#define TIMELIBCIVIL_H
+
+/*
+ * Constant time civil calendar conversions shared by the library modules,
+ * not part of the public API. The functions are inline so loops that call
+ * them can still be vectorized.
+ */
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include "TimeLib.h"
+
+/*-------------------------------------------------------------*
+ *		Function definitions				*
+ *-------------------------------------------------------------*/
+
+/**
+ * Computes the civil date for the given day count
+ *
+ * Uses a calendar where years start on March 1st so the leap day is the last
+ * day of each year.
+ *
+ * @param days Days elapsed since Jan 1, 1970
+ * @param year Receives the calendar year
+ * @param month Receives the month (1-12)
+ * @param day Receives the day of the month (1-31)
+ */
+static inline void timelib_civil_from_days(uint32_t days, uint32_t * year, uint8_t * month, uint8_t * day)
+{
+	uint32_t z, era, doe, yoe, doy, mp;
+
+	z = days + 719468UL;
+	era = z / 146097UL;
+	doe = z - era * 146097UL;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*year = yoe + era * 400 + (mp >= 10 ? 1 : 0);
+	*month = (uint8_t) (mp < 10 ? mp + 3 : mp - 9);
+	*day = (uint8_t) (doy - (153 * mp + 2) / 5 + 1);
+}
+
+/**
+ * Computes the number of days since Jan 1, 1970 for a civil date
+ *
+ * @param year The calendar year (1970 or later)
+ * @param month The month (1-12)
+ * @param day The day of the month (1-31)
+ *
+ * @return Days elapsed since Jan 1, 1970
+ */
+static inline uint32_t timelib_civil_days(uint32_t year, uint8_t month, uint8_t day)
+{
+	uint32_t era, yoe, doy, doe;
+
+	year -= (month <= 2) ? 1 : 0;
+	era = year / 400;
+	yoe = year - era * 400;
+	doy = (153UL * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097UL + doe - 719468UL;
+}
+
+#endif
+// End of Header file
@@ -0,0 +1,204 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#include "TimeLibIndex.h"
+#include "TimeLibCivil.h"
+
+/* Number of searches interleaved by timelib_index_lower_batch() */
+#define TIMELIB_INDEX_BATCH		8
+
+/**
+ * Computes the timestamp where a calendar bucket starts
+ *
+ * Buckets that start before the epoch or after the last timestamp are clamped
+ * to the range of timelib_t.
+ *
+ * @param unit Calendar granularity of the bucket
+ * @param bucket Index of the bucket
+ * @param offset Time zone offset in seconds of the buckets
+ *
+ * @return The first timestamp of the bucket
+ */
+static timelib_t timelib_index_start(enum timelib_bucket_unit unit, uint32_t bucket, int32_t offset)
+{
+	int64_t local = 0;
+
+	switch (unit) {
+	case E_TIMELIB_BUCKET_HOUR:
+		local = (int64_t) bucket * TIMELIB_SECS_PER_HOUR;
+		break;
+	case E_TIMELIB_BUCKET_DAY:
+		local = (int64_t) bucket * TIMELIB_SECS_PER_DAY;
+		break;
+	case E_TIMELIB_BUCKET_WEEK:
+		// Week 0 starts three days before the epoch
+		local = ((int64_t) bucket * TIMELIB_DAYS_PER_WEEK - 3) * TIMELIB_SECS_PER_DAY;
+		break;
+	case E_TIMELIB_BUCKET_MONTH:
+		// Months after 2106 are past the last timestamp anyway
+		if (bucket / 12 > 136)
+			return(timelib_t) 0xFFFFFFFFUL;
+		local = (int64_t) timelib_civil_days(1970 + bucket / 12, (uint8_t) (bucket % 12 + 1), 1) * TIMELIB_SECS_PER_DAY;
+		break;
+	}
+	local -= offset;
+	if (local < 0)
+		return 0;
+	if (local > (int64_t) 0xFFFFFFFFUL)
+		return(timelib_t) 0xFFFFFFFFUL;
+	return(timelib_t) local;
+}
+
+/*-------------------------------------------------------------*
+ *	Public API, check TimeLibIndex.h for documentation	*
+ *-------------------------------------------------------------*/
+size_t timelib_index_lower(const timelib_t * times, size_t count, timelib_t key)
+{
+	const timelib_t * base = times;
+	size_t half;
+
+	if (count == 0)
+		return 0;
+	while (count > 1) {
+		half = count / 2;
+		// Compilers turn this into a conditional move
+		base = (base[half] < key) ? base + half : base;
+		count -= half;
+	}
+	return(size_t) (base - times) + (*base < key);
+}
+
+void timelib_index_lower_batch(const timelib_t * times, size_t count, const timelib_t * keys, size_t * pos, size_t n)
+{
+	const timelib_t * base[TIMELIB_INDEX_BATCH];
+	size_t half, len, i, m;
+
+	while (n != 0) {
+		m = (n < TIMELIB_INDEX_BATCH) ? n : TIMELIB_INDEX_BATCH;
+		if (count == 0) {
+			for (i = 0; i < m; i++)
+				pos[i] = 0;
+		} else {
+			// Every search halves the same length, run them in lockstep
+			for (i = 0; i < m; i++)
+				base[i] = times;
+			for (len = count; len > 1; len -= half) {
+				half = len / 2;
+				for (i = 0; i < m; i++)
+					base[i] = (base[i][half] < keys[i]) ? base[i] + half : base[i];
+			}
+			for (i = 0; i < m; i++)
+				pos[i] = (size_t) (base[i] - times) + (*base[i] < keys[i]);
+		}
+		keys += m;
+		pos += m;
+		n -= m;
+	}
+}
+
+void timelib_index_build(struct timelib_index * idx, const timelib_t * times, size_t count, enum timelib_bucket_unit unit, int32_t offset, size_t * dir, size_t size)
+{
+	uint32_t bucket;
+	size_t i = 0, k;
+
+	idx->times = times;
+	idx->count = count;
+	idx->unit = unit;
+	idx->offset = offset;
+	idx->dir = 0;
+	idx->buckets = 0;
+	idx->first = 0;
+	if (dir == 0 || size < 2 || count == 0)
+		return;
+
+	timelib_bucket_index(&times[0], &idx->first, 1, unit, offset);
+	timelib_bucket_index(&times[count - 1], &bucket, 1, unit, offset);
+	idx->buckets = bucket - idx->first + 1;
+	if (idx->buckets > size - 1)
+		idx->buckets = size - 1;
+	idx->dir = dir;
+
+	// Single pass, each timestamp is mapped to its bucket once
+	dir[0] = 0;
+	for (k = 1; k <= idx->buckets; k++) {
+		while (i < count) {
+			timelib_bucket_index(&times[i], &bucket, 1, unit, offset);
+			if (bucket >= idx->first + k)
+				break;
+			i++;
+		}
+		dir[k] = i;
+	}
+}
+
+size_t timelib_index_bucket(const struct timelib_index * idx, uint32_t bucket, size_t * begin, size_t * end)
+{
+	uint32_t b = bucket - idx->first;
+
+	if (idx->dir != 0 && bucket >= idx->first && b < idx->buckets) {
+		*begin = idx->dir[b];
+		*end = idx->dir[b + 1];
+		return *end - *begin;
+	}
+	return timelib_index_range(idx, timelib_index_start(idx->unit, bucket, idx->offset),
+		timelib_index_start(idx->unit, bucket + 1, idx->offset), begin, end);
+}
+
+size_t timelib_index_range(const struct timelib_index * idx, timelib_t from, timelib_t to, size_t * begin, size_t * end)
+{
+	uint32_t bucket, b;
+	size_t lo, hi;
+
+	if (to <= from) {
+		*begin = *end = timelib_index_lower(idx->times, idx->count, from);
+		return 0;
+	}
+	// Narrow the searches to the directory buckets that contain the bounds
+	lo = 0;
+	hi = idx->count;
+	if (idx->dir != 0) {
+		timelib_bucket_index(&from, &bucket, 1, idx->unit, idx->offset);
+		b = bucket - idx->first;
+		if (bucket >= idx->first && b < idx->buckets) {
+			lo = idx->dir[b];
+			hi = idx->dir[b + 1];
+		}
+	}
+	*begin = lo + timelib_index_lower(idx->times + lo, hi - lo, from);
+	lo = *begin;
+	hi = idx->count;
+	if (idx->dir != 0) {
+		timelib_bucket_index(&to, &bucket, 1, idx->unit, idx->offset);
+		b = bucket - idx->first;
+		if (bucket >= idx->first && b < idx->buckets && idx->dir[b] >= lo) {
+			lo = idx->dir[b];
+			hi = idx->dir[b + 1];
+		}
+	}
+	*end = lo + timelib_index_lower(idx->times + lo, hi - lo, to);
+	return *end - *begin;
+}
+
+void timelib_index_counts(const struct timelib_index * idx, uint32_t first, size_t * counts, size_t n)
+{
+	size_t i, begin, end;
+
+	for (i = 0; i < n; i++)
+		counts[i] = timelib_index_bucket(idx, first + (uint32_t) i, &begin, &end);
+}
@@ -0,0 +1,142 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBINDEX_H
+#define TIMELIBINDEX_H
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include "TimeLib.h"
+#include "TimeLibBucket.h"
+
+/*-------------------------------------------------------------*
+ *		Typedefs enums & structs			*
+ *-------------------------------------------------------------*/
+
+/**
+ * @brief Calendar index over a sorted array of timestamps
+ *
+ * The optional directory stores, for each calendar bucket on a range, the
+ * position of the first timestamp of the bucket, so bucket queries take
+ * constant time. Queries outside the directory fall back to binary search.
+ */
+struct timelib_index {
+	const timelib_t * times; //!< Sorted array of timestamps
+	size_t count; //!< Number of timestamps
+	size_t * dir; //!< Directory, buckets + 1 positions or null
+	size_t buckets; //!< Number of buckets covered by the directory
+	uint32_t first; //!< Bucket index of dir[0]
+	int32_t offset; //!< Time zone offset in seconds of the buckets
+	enum timelib_bucket_unit unit; //!< Calendar granularity of the buckets
+};
+
+/*-------------------------------------------------------------*
+ *		Function prototypes				*
+ *-------------------------------------------------------------*/
+#ifdef	__cplusplus
+extern "C" {
+#endif
+	/**
+	 * @brief Finds the first element not earlier than the given timestamp
+	 *
+	 * Branch free binary search, the loop always runs the same number of
+	 * steps for a given array length.
+	 *
+	 * @param times Sorted array of timestamps
+	 * @param count Number of timestamps
+	 * @param key The timestamp to search for
+	 *
+	 * @return Position of the first element greater or equal than key, count
+	 * if there is none
+	 */
+	size_t timelib_index_lower(const timelib_t * times, size_t count, timelib_t key);
+
+	/**
+	 * @brief Runs timelib_index_lower() for several keys at once
+	 *
+	 * Searches are interleaved so the memory accesses of different keys
+	 * overlap.
+	 *
+	 * @param times Sorted array of timestamps
+	 * @param count Number of timestamps
+	 * @param keys Array of timestamps to search for
+	 * @param pos Array that receives the position for each key
+	 * @param n Number of keys
+	 */
+	void timelib_index_lower_batch(const timelib_t * times, size_t count, const timelib_t * keys, size_t * pos, size_t n);
+
+	/**
+	 * @brief Builds a calendar index over a sorted array of timestamps
+	 *
+	 * The directory covers the buckets from the one of the first timestamp
+	 * on, up to the number that fits on the given storage.
+	 *
+	 * @param idx Pointer to the index
+	 * @param times Sorted array of timestamps, must remain valid while the
+	 * index is used
+	 * @param count Number of timestamps
+	 * @param unit Calendar granularity of the buckets
+	 * @param offset Time zone offset in seconds of the buckets
+	 * @param dir Storage for the directory or null to build no directory
+	 * @param size Number of elements of the directory storage
+	 */
+	void timelib_index_build(struct timelib_index * idx, const timelib_t * times, size_t count, enum timelib_bucket_unit unit, int32_t offset, size_t * dir, size_t size);
+
+	/**
+	 * @brief Gets the elements that fall on a calendar bucket
+	 *
+	 * @param idx Pointer to the index
+	 * @param bucket Index of the bucket as computed by timelib_bucket_index()
+	 * @param begin Receives the position of the first element of the bucket
+	 * @param end Receives the position after the last element of the bucket
+	 *
+	 * @return The number of elements on the bucket
+	 */
+	size_t timelib_index_bucket(const struct timelib_index * idx, uint32_t bucket, size_t * begin, size_t * end);
+
+	/**
+	 * @brief Gets the elements between two timestamps
+	 *
+	 * @param idx Pointer to the index
+	 * @param from First timestamp of the range (included)
+	 * @param to Last timestamp of the range (excluded)
+	 * @param begin Receives the position of the first element of the range
+	 * @param end Receives the position after the last element of the range
+	 *
+	 * @return The number of elements on the range
+	 */
+	size_t timelib_index_range(const struct timelib_index * idx, timelib_t from, timelib_t to, size_t * begin, size_t * end);
+
+	/**
+	 * @brief Counts the elements on consecutive calendar buckets
+	 *
+	 * @param idx Pointer to the index
+	 * @param first Index of the first bucket
+	 * @param counts Array that receives the number of elements per bucket
+	 * @param n Number of buckets
+	 */
+	void timelib_index_counts(const struct timelib_index * idx, uint32_t first, size_t * counts, size_t n);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
+// End of Header file
@@ -23,10 +23,26 @@
 #if defined( PLIB_PIC16 ) || defined( PLIB_PIC18 ) || defined( PLIB_PIC24 )
 
 #include <xc.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <Tick.h>
 
+/*
+ * The lock disables interrupts and saves their previous state on the given
+ * variable, the unlock restores it, so locking with interrupts already
+ * disabled does not enable them on the way out.
+ */
+#if defined( PLIB_PIC24 )
+typedef uint16_t timelib_port_state_t;
+#define timelib_port_lock(s)	do { uint16_t ipl; SET_AND_SAVE_CPU_IPL(ipl, 7); (s) = ipl; } while (0)
+#define timelib_port_unlock(s)	RESTORE_CPU_IPL(s)
+#else
+typedef uint8_t timelib_port_state_t;
+#define timelib_port_lock(s)	do { uint8_t gie = INTCONbits.GIE; di(); (s) = gie; } while (0)
+#define timelib_port_unlock(s)	do { if (s) ei(); } while (0)
+#endif
+
 #elif defined( ARDUINO )
 
 #if ARDUINO < 100
@@ -44,7 +60,107 @@
 #define TICK_MINUTE		((unsigned long long)TICKS_PER_SECOND*60ull)
 #define TICK_HOUR		((unsigned long long)TICKS_PER_SECOND*3600ull)
 #define tick_get()		millis()
+#define TIMELIB_STATS_CLOCK()	micros()
+
+/*
+ * The lock disables interrupts and saves their previous state on the given
+ * variable, the unlock restores it. Cores without a status register access
+ * enable interrupts on unlock.
+ */
+#if defined( __AVR__ )
+typedef uint8_t timelib_port_state_t;
+#define timelib_port_lock(s)	do { uint8_t sreg = SREG; cli(); (s) = sreg; } while (0)
+#define timelib_port_unlock(s)	(SREG = (s))
+#elif defined( __arm__ )
+typedef uint32_t timelib_port_state_t;
+#define timelib_port_lock(s)	do { uint32_t primask = __get_PRIMASK(); __disable_irq(); (s) = primask; } while (0)
+#define timelib_port_unlock(s)	__set_PRIMASK(s)
+#else
+typedef uint8_t timelib_port_state_t;
+#define timelib_port_lock(s)	do { noInterrupts(); (s) = 0; } while (0)
+#define timelib_port_unlock(s)	interrupts()
+#endif
+
+#elif defined( __unix__ ) || defined( __APPLE__ )
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
+#define TIMELIB_PORT_POSIX
+
+#define TICKS_PER_SECOND	1000ul
+#define TICK_SECOND		((unsigned long)TICKS_PER_SECOND)
+#define TICK_MINUTE		((unsigned long)TICKS_PER_SECOND*60ul)
+#define TICK_HOUR		((unsigned long)TICKS_PER_SECOND*3600ul)
+#define tick_get()		timelib_port_ticks(1000ul)
+#define TIMELIB_STATS_CLOCK()	timelib_port_ticks(1000000ul)
+
+/* A mutex protects the clock, there is no interrupt state to keep */
+typedef int timelib_port_state_t;
+#define timelib_port_lock(s)	((void) (s), timelib_port_mutex_lock())
+#define timelib_port_unlock(s)	((void) (s), timelib_port_mutex_unlock())
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+	/**
+	 * Reads the monotonic clock of the operating system, defined in TimeLib.c
+	 * so applications do not inherit the POSIX feature macros it needs
+	 *
+	 * @param hz Number of ticks per second of the returned value
+	 *
+	 * @return Ticks elapsed since an arbitrary point, wraps around on overflow
+	 */
+	unsigned long timelib_port_ticks(unsigned long hz);
+
+	/**
+	 * Locks the default clock against the coarse clock thread, defined in
+	 * TimeLib.c when the coarse clock is enabled
+	 */
+	void timelib_port_mutex_lock();
+
+	/**
+	 * Unlocks the default clock
+	 */
+	void timelib_port_mutex_unlock();
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
+
+/*
+ * Atomic helpers for variables shared between interrupt / thread contexts. On
+ * targets that provide lock free 32 bit operations the GCC builtins are used
+ * with relaxed ordering, on other targets they resolve to plain accesses. The
+ * acquire and release fences order plain data around a sequence counter, they
+ * are compiler barriers on single core targets.
+ */
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2) && (__SIZEOF_INT__ >= 4)
+#define TIMELIB_ATOMIC_LOCK_FREE
+#define timelib_atomic_add(p, v)	__atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define timelib_atomic_load(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+#define timelib_atomic_store(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define timelib_atomic_fence()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define timelib_atomic_load_acquire(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define timelib_atomic_store_release(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define timelib_atomic_fence_acquire()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define timelib_atomic_fence_release()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define timelib_atomic_add(p, v)	(*(p) += (v))
+#define timelib_atomic_load(p)		(*(p))
+#define timelib_atomic_store(p, v)	(*(p) = (v))
+#define timelib_atomic_fence()
+#define timelib_atomic_load_acquire(p)	(*(p))
+#define timelib_atomic_store_release(p, v)	(*(p) = (v))
+#if defined(__GNUC__)
+#define timelib_atomic_fence_acquire()	__asm__ __volatile__("" ::: "memory")
+#define timelib_atomic_fence_release()	__asm__ __volatile__("" ::: "memory")
+#else
+#define timelib_atomic_fence_acquire()
+#define timelib_atomic_fence_release()
+#endif
 #endif
 
 #endif
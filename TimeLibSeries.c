@@ -0,0 +1,291 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#include "TimeLibSeries.h"
+
+/**
+ * Writes bits to the series buffer, most significant bit first
+ *
+ * @param s Pointer to the encoder state
+ * @param value The bits to write, right aligned
+ * @param count Number of bits to write (1 - 32)
+ */
+static void timelib_series_bits(struct timelib_series * s, uint32_t value, uint8_t count)
+{
+	uint8_t n;
+
+	while (count != 0) {
+		// Clear each byte the first time we touch it
+		if (s->bit == 0)
+			s->buf[s->pos] = 0;
+		n = 8 - s->bit;
+		if (n > count)
+			n = count;
+		count -= n;
+		s->buf[s->pos] |= (uint8_t) (((value >> count) & ((1u << n) - 1)) << (8 - s->bit - n));
+		s->bit += n;
+		if (s->bit == 8) {
+			s->bit = 0;
+			s->pos++;
+		}
+	}
+}
+
+/**
+ * Writes the header of the open block and leaves the encoder ready for a new
+ * block
+ *
+ * @param s Pointer to the encoder state
+ */
+static void timelib_series_close(struct timelib_series * s)
+{
+	size_t len;
+
+	// Skip the partially written byte
+	if (s->bit != 0) {
+		s->bit = 0;
+		s->pos++;
+	}
+	len = s->pos - s->block - TIMELIB_SERIES_HEADER;
+	s->buf[s->block] = (uint8_t) len;
+	s->buf[s->block + 1] = (uint8_t) (len >> 8);
+	s->buf[s->block + 2] = s->count;
+	s->block = s->pos;
+	s->count = 0;
+}
+
+void timelib_series_init(struct timelib_series * s, uint8_t * buf, size_t size)
+{
+	s->buf = buf;
+	s->size = size;
+	s->block = 0;
+	s->pos = 0;
+	s->bit = 0;
+	s->count = 0;
+	s->last = 0;
+	s->delta = 0;
+}
+
+bool timelib_series_put(struct timelib_series * s, timelib_t time)
+{
+	uint32_t delta;
+	int32_t dod;
+
+	// First timestamp of a block goes on the header
+	if (s->count == 0) {
+		if (s->size - s->pos < TIMELIB_SERIES_HEADER)
+			return false;
+		s->buf[s->pos + 3] = (uint8_t) time;
+		s->buf[s->pos + 4] = (uint8_t) (time >> 8);
+		s->buf[s->pos + 5] = (uint8_t) (time >> 16);
+		s->buf[s->pos + 6] = (uint8_t) (time >> 24);
+		s->pos += TIMELIB_SERIES_HEADER;
+		s->count = 1;
+		s->last = time;
+		s->delta = 0;
+		return true;
+	}
+
+	// Worst case code is 36 bits long
+	if (s->size - s->pos < (size_t) ((s->bit + 36 + 7) / 8))
+		return false;
+
+	// Differences are computed modulo 2^32 so any sequence can be stored
+	delta = time - s->last;
+	dod = (int32_t) (delta - s->delta);
+	if (dod == 0) {
+		timelib_series_bits(s, 0x0, 1);
+	} else if (dod >= -63 && dod <= 64) {
+		timelib_series_bits(s, 0x2, 2);
+		timelib_series_bits(s, (uint32_t) (dod + 63), 7);
+	} else if (dod >= -255 && dod <= 256) {
+		timelib_series_bits(s, 0x6, 3);
+		timelib_series_bits(s, (uint32_t) (dod + 255), 9);
+	} else if (dod >= -2047 && dod <= 2048) {
+		timelib_series_bits(s, 0xE, 4);
+		timelib_series_bits(s, (uint32_t) (dod + 2047), 12);
+	} else {
+		timelib_series_bits(s, 0xF, 4);
+		timelib_series_bits(s, (uint32_t) dod, 32);
+	}
+	s->last = time;
+	s->delta = delta;
+
+	if (++s->count == CONFIG_TIMELIB_SERIES_BLOCK)
+		timelib_series_close(s);
+	return true;
+}
+
+size_t timelib_series_finish(struct timelib_series * s)
+{
+	if (s->count != 0)
+		timelib_series_close(s);
+	return s->pos;
+}
+
+void timelib_series_reader_init(struct timelib_series_reader * r, const uint8_t * buf, size_t size)
+{
+	r->buf = buf;
+	r->size = size;
+	r->pos = 0;
+}
+
+bool timelib_series_seek(struct timelib_series_reader * r, unsigned int block)
+{
+	size_t len;
+
+	r->pos = 0;
+	while (r->size - r->pos >= TIMELIB_SERIES_HEADER) {
+		if (block-- == 0)
+			return true;
+		len = r->buf[r->pos] | ((size_t) r->buf[r->pos + 1] << 8);
+		r->pos += TIMELIB_SERIES_HEADER + len;
+		if (r->pos > r->size)
+			break;
+	}
+	r->pos = r->size;
+	return false;
+}
+
+uint8_t timelib_series_read(struct timelib_series_reader * r, timelib_t * out)
+{
+	const uint8_t * p;
+	const uint8_t * end;
+	uint32_t acc = 0;
+	uint8_t nacc = 0;
+	uint8_t count, i, n;
+	uint32_t delta = 0;
+	uint32_t dod;
+	timelib_t time;
+	size_t len;
+
+	if (r->size - r->pos < TIMELIB_SERIES_HEADER)
+		return 0;
+	p = r->buf + r->pos;
+	len = p[0] | ((size_t) p[1] << 8);
+	count = p[2];
+	if (count == 0 || count > CONFIG_TIMELIB_SERIES_BLOCK || len > r->size - r->pos - TIMELIB_SERIES_HEADER)
+		return 0;
+	time = (timelib_t) p[3] | ((timelib_t) p[4] << 8) | ((timelib_t) p[5] << 16) | ((timelib_t) p[6] << 24);
+	end = p + TIMELIB_SERIES_HEADER + len;
+	p += TIMELIB_SERIES_HEADER;
+	out[0] = time;
+
+	// Bit accumulator holds nacc valid bits aligned to the left
+	for (i = 1; i < count;) {
+		while (nacc <= 24 && p < end) {
+			acc |= (uint32_t) * p++ << (24 - nacc);
+			nacc += 8;
+		}
+		if (nacc == 0)
+			return 0;
+		// Fast path for regular series: each leading zero repeats the delta
+		if ((acc & 0x80000000UL) == 0) {
+#if defined(__GNUC__)
+			n = (acc == 0) ? 32 : (uint8_t) (__builtin_clzl(acc) - (sizeof(long) * 8 - 32));
+#else
+			for (n = 0; n < 32 && (acc & (0x80000000UL >> n)) == 0; n++);
+#endif
+			if (n > nacc)
+				n = nacc;
+			if (n > count - i)
+				n = count - i;
+			acc = (n == 32) ? 0 : acc << n;
+			nacc -= n;
+			while (n-- != 0) {
+				time += delta;
+				out[i++] = time;
+			}
+			continue;
+		}
+		// Decode prefix and fixed width value
+		if ((acc & 0x40000000UL) == 0) {
+			if (nacc < 9)
+				return 0;
+			dod = ((acc >> 23) & 0x7F) - 63;
+			acc <<= 9;
+			nacc -= 9;
+		} else if ((acc & 0x20000000UL) == 0) {
+			if (nacc < 12)
+				return 0;
+			dod = ((acc >> 20) & 0x1FF) - 255;
+			acc <<= 12;
+			nacc -= 12;
+		} else if ((acc & 0x10000000UL) == 0) {
+			if (nacc < 16)
+				return 0;
+			dod = ((acc >> 16) & 0xFFF) - 2047;
+			acc <<= 16;
+			nacc -= 16;
+		} else {
+			// Escape: 4 bit prefix and 32 bit raw value, read in two halves
+			acc <<= 4;
+			nacc -= 4;
+			while (nacc <= 24 && p < end) {
+				acc |= (uint32_t) * p++ << (24 - nacc);
+				nacc += 8;
+			}
+			if (nacc < 16)
+				return 0;
+			dod = acc & 0xFFFF0000UL;
+			acc <<= 16;
+			nacc -= 16;
+			while (nacc <= 24 && p < end) {
+				acc |= (uint32_t) * p++ << (24 - nacc);
+				nacc += 8;
+			}
+			if (nacc < 16)
+				return 0;
+			dod |= acc >> 16;
+			acc <<= 16;
+			nacc -= 16;
+		}
+		delta += dod;
+		time += delta;
+		out[i++] = time;
+	}
+
+	r->pos = (size_t) (end - r->buf);
+	return count;
+}
+
+uint8_t timelib_series_read_tm(struct timelib_series_reader * r, struct timelib_tm * out)
+{
+	timelib_t times[CONFIG_TIMELIB_SERIES_BLOCK];
+	timelib_t midnight = 0;
+	uint32_t secs;
+	uint8_t count, i;
+
+	count = timelib_series_read(r, times);
+	for (i = 0; i < count; i++) {
+		secs = times[i] - midnight;
+		if (i == 0 || times[i] < midnight || secs >= TIMELIB_SECS_PER_DAY) {
+			// New day, run the full conversion
+			timelib_break(times[i], &out[i]);
+			midnight = timelib_prev_midnight(times[i]);
+		} else {
+			// Same day, only the time of day changes
+			out[i] = out[i - 1];
+			out[i].tm_sec = secs % 60;
+			out[i].tm_min = (secs / 60) % 60;
+			out[i].tm_hour = secs / 3600;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,171 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBSERIES_H
+#define TIMELIBSERIES_H
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include "TimeLib.h"
+
+/*-------------------------------------------------------------*
+ *		Library configuration				*
+ *-------------------------------------------------------------*/
+
+/**
+ * Maximum number of timestamps stored on each block of a series (1 - 255).
+ * Every block can be decoded on its own, so smaller blocks give finer random
+ * access and larger blocks give better compression. Buffers passed to the
+ * decoding functions must hold this many elements.
+ */
+#define CONFIG_TIMELIB_SERIES_BLOCK	128
+
+/*-------------------------------------------------------------*
+ *		Macros and definitions				*
+ *-------------------------------------------------------------*/
+/**
+ * Size in bytes of the header at the start of each block: payload length (2),
+ * number of timestamps (1) and first timestamp (4), all little endian.
+ */
+#define TIMELIB_SERIES_HEADER		7
+
+/*-------------------------------------------------------------*
+ *		Typedefs enums & structs			*
+ *-------------------------------------------------------------*/
+
+/**
+ * @brief Encoder state for a compressed timestamp series
+ *
+ * Timestamps are stored as the difference between consecutive deltas (delta
+ * of delta) using a variable length bit prefix code: a regular series costs a
+ * single bit per timestamp.
+ */
+struct timelib_series {
+	uint8_t * buf; //!< Output buffer
+	size_t size; //!< Size of the output buffer in bytes
+	size_t block; //!< Offset of the header of the open block
+	size_t pos; //!< Offset of the byte being written
+	uint8_t bit; //!< Number of bits used on the byte being written
+	uint8_t count; //!< Number of timestamps on the open block
+	timelib_t last; //!< Last timestamp written
+	uint32_t delta; //!< Last delta written
+};
+
+/**
+ * @brief Decoder state for a compressed timestamp series
+ */
+struct timelib_series_reader {
+	const uint8_t * buf; //!< Encoded series
+	size_t size; //!< Size of the encoded series in bytes
+	size_t pos; //!< Offset of the next block to decode
+};
+
+/*-------------------------------------------------------------*
+ *		Function prototypes				*
+ *-------------------------------------------------------------*/
+#ifdef	__cplusplus
+extern "C" {
+#endif
+	/**
+	 * @brief Prepares an encoder to write a new series
+	 *
+	 * @param s Pointer to the encoder state
+	 * @param buf Buffer that receives the encoded series
+	 * @param size Size of the buffer in bytes
+	 */
+	void timelib_series_init(struct timelib_series * s, uint8_t * buf, size_t size);
+
+	/**
+	 * @brief Appends a timestamp to the series
+	 *
+	 * @param s Pointer to the encoder state
+	 * @param time The timestamp to append
+	 *
+	 * @return Returns true if the timestamp was stored, false if the buffer is
+	 * full
+	 */
+	bool timelib_series_put(struct timelib_series * s, timelib_t time);
+
+	/**
+	 * @brief Closes the open block of the series
+	 *
+	 * After this call the buffer holds a complete series that can be decoded.
+	 * More timestamps can be appended later, they are stored on a new block.
+	 *
+	 * @param s Pointer to the encoder state
+	 *
+	 * @return The number of bytes used on the buffer
+	 */
+	size_t timelib_series_finish(struct timelib_series * s);
+
+	/**
+	 * @brief Prepares a reader to decode a series from the start
+	 *
+	 * @param r Pointer to the decoder state
+	 * @param buf Buffer holding the encoded series
+	 * @param size Number of bytes of the encoded series
+	 */
+	void timelib_series_reader_init(struct timelib_series_reader * r, const uint8_t * buf, size_t size);
+
+	/**
+	 * @brief Moves the reader to the given block
+	 *
+	 * Only block headers are read, no timestamps are decoded.
+	 *
+	 * @param r Pointer to the decoder state
+	 * @param block Index of the block to move to, counting from zero
+	 *
+	 * @return Returns true if the block exists, false otherwise
+	 */
+	bool timelib_series_seek(struct timelib_series_reader * r, unsigned int block);
+
+	/**
+	 * @brief Decodes the next block of the series
+	 *
+	 * @param r Pointer to the decoder state
+	 * @param out Array of CONFIG_TIMELIB_SERIES_BLOCK elements that receives
+	 * the timestamps
+	 *
+	 * @return The number of timestamps decoded, 0 at the end of the series or
+	 * if the data is corrupt
+	 */
+	uint8_t timelib_series_read(struct timelib_series_reader * r, timelib_t * out);
+
+	/**
+	 * @brief Decodes the next block of the series into time structures
+	 *
+	 * Consecutive timestamps on the same day are broken down without running
+	 * the full timelib_break() conversion.
+	 *
+	 * @param r Pointer to the decoder state
+	 * @param out Array of CONFIG_TIMELIB_SERIES_BLOCK elements that receives
+	 * the human readable time of each timestamp
+	 *
+	 * @return The number of timestamps decoded, 0 at the end of the series or
+	 * if the data is corrupt
+	 */
+	uint8_t timelib_series_read_tm(struct timelib_series_reader * r, struct timelib_tm * out);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
+// End of Header file
@@ -0,0 +1,484 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/* POSIX declarations on hosted builds, must come before any system header */
+#if (defined( __unix__ ) || defined( __APPLE__ )) && !defined( _POSIX_C_SOURCE )
+#define _POSIX_C_SOURCE		200809L
+#endif
+
+#include "TimeLibSntp.h"
+
+#include <string.h>
+#if defined(TIMELIB_PORT_POSIX)
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+/* First byte of a request: no leap warning, version 4, client mode */
+#define SNTP_REQUEST_FLAGS	0x23
+/* Offsets of the packet fields */
+#define SNTP_OFF_STRATUM	1
+#define SNTP_OFF_REFID		12
+#define SNTP_OFF_REFERENCE	16
+#define SNTP_OFF_ORIGINATE	24
+#define SNTP_OFF_RECEIVE	32
+#define SNTP_OFF_TRANSMIT	40
+
+#if defined(CONFIG_TIMELIB_MONO)
+/* Function used to exchange packets with the server */
+timelib_sntp_transport_t sntp_transport = 0;
+/* Context passed to the transport */
+void * sntp_ctx = 0;
+/* Non blocking transport and its context */
+timelib_sntp_send_t sntp_send = 0;
+timelib_sntp_recv_t sntp_recv = 0;
+void * sntp_async_ctx = 0;
+/* Request waiting for its reply on the non blocking mode */
+bool sntp_pending = false;
+timelib_ntp_t sntp_cookie = 0;
+uint64_t sntp_sent = 0;
+
+/**
+ * Reads a big endian NTP timestamp from a packet
+ *
+ * @param buf Pointer to the first byte of the timestamp
+ *
+ * @return The NTP timestamp
+ */
+static timelib_ntp_t timelib_sntp_read_ts(const uint8_t * buf)
+{
+	timelib_ntp_t ntp = 0;
+	uint8_t i;
+
+	for (i = 0; i < 8; i++)
+		ntp = (ntp << 8) | buf[i];
+	return ntp;
+}
+
+/**
+ * Writes a NTP timestamp to a packet in big endian order
+ *
+ * @param buf Pointer to the first byte of the timestamp
+ * @param ntp The NTP timestamp
+ */
+static void timelib_sntp_write_ts(uint8_t * buf, timelib_ntp_t ntp)
+{
+	uint8_t i;
+
+	for (i = 8; i > 0; i--) {
+		buf[i - 1] = (uint8_t) ntp;
+		ntp >>= 8;
+	}
+}
+
+/**
+ * Converts a monotonic instant to NTP format
+ *
+ * @param mono Microseconds of the monotonic clock
+ *
+ * @return The NTP timestamp, counted from the start of the monotonic clock
+ */
+static timelib_ntp_t timelib_sntp_mono_ts(uint64_t mono)
+{
+	return timelib_ntp_from_time((timelib_t) (mono / 1000000ULL) - TIMELIB_NTP_UNIX_OFFSET,
+		(uint32_t) (mono % 1000000ULL));
+}
+
+/**
+ * Gets the wall time of a monotonic instant in NTP format
+ *
+ * @param mono Microseconds of the monotonic clock
+ *
+ * @return The NTP timestamp of the default clock
+ */
+static timelib_ntp_t timelib_sntp_wall_ts(uint64_t mono)
+{
+	timelib_t time;
+	uint16_t ms;
+
+	time = timelib_mono_to_wall(mono, &ms);
+	return timelib_ntp_from_time(time, (uint32_t) ms * 1000UL + (uint32_t) (mono % 1000ULL));
+}
+
+/**
+ * Builds a client request
+ *
+ * @param packet Buffer that receives the request
+ * @param mono Monotonic instant when the request is sent
+ *
+ * @return The transmit timestamp of the request, the reply must echo it
+ */
+static timelib_ntp_t timelib_sntp_prepare(uint8_t * packet, uint64_t mono)
+{
+	timelib_ntp_t cookie;
+
+	memset(packet, 0, TIMELIB_SNTP_PACKET_SIZE);
+	packet[0] = SNTP_REQUEST_FLAGS;
+	// The transmit timestamp only matches the reply to the request
+	cookie = timelib_sntp_mono_ts(mono);
+	timelib_sntp_write_ts(&packet[SNTP_OFF_TRANSMIT], cookie);
+	return cookie;
+}
+
+/**
+ * Validates a reply as specified by RFC 4330 section 5
+ *
+ * @param packet The reply
+ * @param cookie The transmit timestamp of the request
+ * @param sample Receives the server timestamps and stratum
+ *
+ * @return Returns true if the reply is valid
+ */
+static bool timelib_sntp_check(const uint8_t * packet, timelib_ntp_t cookie, struct timelib_sntp_sample * sample)
+{
+	// Server mode, clock synchronized and not a kiss of death
+	if ((packet[0] & 0x07) != 4 || (packet[0] & 0xC0) == 0xC0)
+		return false;
+	if (packet[SNTP_OFF_STRATUM] == 0 || packet[SNTP_OFF_STRATUM] > 15)
+		return false;
+	// Reply to our request with a valid time
+	if (timelib_sntp_read_ts(&packet[SNTP_OFF_ORIGINATE]) != cookie)
+		return false;
+	sample->t2 = timelib_sntp_read_ts(&packet[SNTP_OFF_RECEIVE]);
+	sample->t3 = timelib_sntp_read_ts(&packet[SNTP_OFF_TRANSMIT]);
+	if (sample->t3 == 0)
+		return false;
+	sample->stratum = packet[SNTP_OFF_STRATUM];
+	return true;
+}
+
+/**
+ * Sends a request and waits for a valid reply
+ *
+ * @param sample Receives the server timestamps and stratum
+ * @param m1 Receives the monotonic instant when the request was sent
+ * @param m4 Receives the monotonic instant when the reply arrived
+ *
+ * @return Returns true if a valid reply was received
+ */
+static bool timelib_sntp_exchange(struct timelib_sntp_sample * sample, uint64_t * m1, uint64_t * m4)
+{
+	uint8_t packet[TIMELIB_SNTP_PACKET_SIZE];
+	timelib_ntp_t cookie;
+
+	// Check that a transport was set
+	if (sntp_transport == 0)
+		return false;
+	*m1 = timelib_mono_us();
+	cookie = timelib_sntp_prepare(packet, *m1);
+	if (!sntp_transport(sntp_ctx, packet, CONFIG_TIMELIB_SNTP_TIMEOUT))
+		return false;
+	*m4 = timelib_mono_us();
+	return timelib_sntp_check(packet, cookie, sample);
+}
+
+/**
+ * Computes the server time when the reply arrived
+ *
+ * @param sample The server timestamps
+ * @param m1 Monotonic instant when the request was sent
+ * @param m4 Monotonic instant when the reply arrived
+ *
+ * @return The server time rounded to the nearest second
+ */
+static timelib_t timelib_sntp_time(const struct timelib_sntp_sample * sample, uint64_t m1, uint64_t m4)
+{
+	int64_t delay;
+	timelib_t time;
+	uint32_t us;
+
+	// Local timestamps come from the monotonic clock, reading the clock
+	// being synced from its own provider is not allowed
+	delay = (int64_t) (m4 - m1) - timelib_ntp_interval(sample->t3, sample->t2);
+	if (delay < 0)
+		delay = 0;
+	// Server time when the reply arrived, rounded to the nearest second
+	time = timelib_ntp_to_time(sample->t3, &us);
+	delay = (int64_t) us + delay / 2 + 500000LL;
+	return time + (timelib_t) (delay / 1000000LL);
+}
+#endif
+
+/*-------------------------------------------------------------*
+ *	Public API, check TimeLibSntp.h for documentation	*
+ *-------------------------------------------------------------*/
+timelib_ntp_t timelib_ntp_from_time(timelib_t time, uint32_t us)
+{
+	// 2^32 / 10^6 scaled by 2^22 avoids the division, rounding up keeps
+	// the microseconds exact on the way back
+	return((timelib_ntp_t) (uint32_t) (time + TIMELIB_NTP_UNIX_OFFSET) << 32)
+		| (uint32_t) (((uint64_t) us * 18014398510ULL + 0x3FFFFFULL) >> 22);
+}
+
+timelib_t timelib_ntp_to_time(timelib_ntp_t ntp, uint32_t * us)
+{
+	if (us != 0)
+		*us = (uint32_t) (((ntp & 0xFFFFFFFFULL) * 1000000ULL) >> 32);
+	// Unsigned wrap around maps NTP era 1 after the 2036 rollover
+	return(timelib_t) ((uint32_t) (ntp >> 32) - TIMELIB_NTP_UNIX_OFFSET);
+}
+
+int64_t timelib_ntp_interval(timelib_ntp_t end, timelib_ntp_t start)
+{
+	uint64_t diff;
+	bool neg;
+
+	// Work on the magnitude and round to the nearest microsecond
+	diff = end - start;
+	neg = (diff >> 63) != 0;
+	if (neg)
+		diff = 0 - diff;
+	diff = (diff >> 32) * 1000000ULL + (((diff & 0xFFFFFFFFULL) * 1000000ULL + 0x80000000ULL) >> 32);
+	return neg ? -(int64_t) diff : (int64_t) diff;
+}
+
+void timelib_sntp_compute(struct timelib_sntp_sample * sample)
+{
+	sample->offset = (timelib_ntp_interval(sample->t2, sample->t1)
+		+ timelib_ntp_interval(sample->t3, sample->t4)) / 2;
+	sample->delay = timelib_ntp_interval(sample->t4, sample->t1)
+		- timelib_ntp_interval(sample->t3, sample->t2);
+}
+
+#if defined(CONFIG_TIMELIB_MONO)
+void timelib_sntp_setup(timelib_sntp_transport_t transport, void * ctx)
+{
+	sntp_transport = transport;
+	sntp_ctx = ctx;
+}
+
+timelib_t timelib_sntp_get()
+{
+	struct timelib_sntp_sample sample;
+	uint64_t m1, m4;
+
+	if (!timelib_sntp_exchange(&sample, &m1, &m4))
+		return 0;
+	return timelib_sntp_time(&sample, m1, m4);
+}
+
+bool timelib_sntp_query(struct timelib_sntp_sample * sample)
+{
+	uint64_t m1, m4;
+
+	if (!timelib_sntp_exchange(sample, &m1, &m4))
+		return false;
+	sample->t1 = timelib_sntp_wall_ts(m1);
+	sample->t4 = timelib_sntp_wall_ts(m4);
+	timelib_sntp_compute(sample);
+	return true;
+}
+
+void timelib_sntp_setup_async(timelib_sntp_send_t send, timelib_sntp_recv_t recv, void * ctx)
+{
+	sntp_send = send;
+	sntp_recv = recv;
+	sntp_async_ctx = ctx;
+	sntp_pending = false;
+}
+
+bool timelib_sntp_request()
+{
+	uint8_t packet[TIMELIB_SNTP_PACKET_SIZE];
+
+	if (sntp_send == 0 || sntp_recv == 0)
+		return false;
+	sntp_sent = timelib_mono_us();
+	sntp_cookie = timelib_sntp_prepare(packet, sntp_sent);
+	sntp_pending = sntp_send(sntp_async_ctx, packet);
+	return sntp_pending;
+}
+
+bool timelib_sntp_poll(struct timelib_clock * clock)
+{
+	uint8_t packet[TIMELIB_SNTP_PACKET_SIZE];
+	struct timelib_sntp_sample sample;
+	timelib_t time;
+	uint64_t m4;
+
+	if (!sntp_pending)
+		return false;
+	// Drain the replies received so far, late replies to older requests
+	// fail the check
+	while (sntp_recv(sntp_async_ctx, packet)) {
+		m4 = timelib_mono_us();
+		if (!timelib_sntp_check(packet, sntp_cookie, &sample))
+			continue;
+		sntp_pending = false;
+		time = timelib_sntp_time(&sample, sntp_sent, m4);
+		if (clock == 0)
+			timelib_set(time);
+		else
+			timelib_clock_set(clock, time);
+		return true;
+	}
+	// Give up on a request that got no answer
+	if (timelib_mono_us() - sntp_sent >= (uint64_t) CONFIG_TIMELIB_SNTP_TIMEOUT * 1000ULL)
+		sntp_pending = false;
+	return false;
+}
+
+bool timelib_sntp_pending()
+{
+	return sntp_pending;
+}
+
+void timelib_sntp_server_init(struct timelib_sntp_server * server, timelib_t time)
+{
+	server->time = time;
+	server->mono = timelib_mono_us();
+	server->stratum = 1;
+	server->requests = 0;
+	server->ready = false;
+}
+
+bool timelib_sntp_server_reply(struct timelib_sntp_server * server, uint8_t * packet)
+{
+	timelib_ntp_t now;
+	uint64_t elapsed;
+
+	// Answer only client requests
+	if ((packet[0] & 0x07) != 3)
+		return false;
+	elapsed = timelib_mono_us() - server->mono;
+	now = timelib_ntp_from_time(server->time + (timelib_t) (elapsed / 1000000ULL),
+		(uint32_t) (elapsed % 1000000ULL));
+	// Keep the client version, set server mode
+	packet[0] = (uint8_t) ((packet[0] & 0x38) | 0x04);
+	packet[SNTP_OFF_STRATUM] = server->stratum;
+	// Keep the poll interval, report millisecond precision (2^-10 s)
+	packet[3] = (uint8_t) - 10;
+	memset(&packet[4], 0, 8);
+	memcpy(&packet[SNTP_OFF_REFID], server->stratum != 0 ? "LOOP" : "DENY", 4);
+	memcpy(&packet[SNTP_OFF_ORIGINATE], &packet[SNTP_OFF_TRANSMIT], 8);
+	timelib_sntp_write_ts(&packet[SNTP_OFF_REFERENCE], now);
+	timelib_sntp_write_ts(&packet[SNTP_OFF_RECEIVE], now);
+	timelib_sntp_write_ts(&packet[SNTP_OFF_TRANSMIT], now);
+	server->requests++;
+	return true;
+}
+
+bool timelib_sntp_loopback(void * ctx, uint8_t * packet, uint16_t timeout)
+{
+	(void) timeout;
+	if (ctx == 0)
+		return false;
+	return timelib_sntp_server_reply((struct timelib_sntp_server *) ctx, packet);
+}
+
+bool timelib_sntp_loopback_send(void * ctx, const uint8_t * packet)
+{
+	struct timelib_sntp_server * server = (struct timelib_sntp_server *) ctx;
+
+	if (server == 0)
+		return false;
+	// Answer at once, the reply waits until it is received
+	memcpy(server->reply, packet, TIMELIB_SNTP_PACKET_SIZE);
+	server->ready = timelib_sntp_server_reply(server, server->reply);
+	return true;
+}
+
+bool timelib_sntp_loopback_recv(void * ctx, uint8_t * packet)
+{
+	struct timelib_sntp_server * server = (struct timelib_sntp_server *) ctx;
+
+	if (server == 0 || !server->ready)
+		return false;
+	memcpy(packet, server->reply, TIMELIB_SNTP_PACKET_SIZE);
+	server->ready = false;
+	return true;
+}
+#endif
+
+#if defined(TIMELIB_PORT_POSIX)
+
+bool timelib_sntp_udp(void * ctx, uint8_t * packet, uint16_t timeout)
+{
+	struct addrinfo hints, * res;
+	struct timeval tv;
+	bool ok = false;
+	int fd;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (ctx == 0 || getaddrinfo((const char *) ctx, "123", &hints, &res) != 0)
+		return false;
+	fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd >= 0) {
+		tv.tv_sec = timeout / 1000;
+		tv.tv_usec = (timeout % 1000) * 1000;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		if (sendto(fd, packet, TIMELIB_SNTP_PACKET_SIZE, 0, res->ai_addr, res->ai_addrlen) == TIMELIB_SNTP_PACKET_SIZE)
+			ok = recv(fd, packet, TIMELIB_SNTP_PACKET_SIZE, 0) == TIMELIB_SNTP_PACKET_SIZE;
+		close(fd);
+	}
+	freeaddrinfo(res);
+	return ok;
+}
+
+bool timelib_sntp_udp_open(struct timelib_sntp_socket * sock, const char * host)
+{
+	struct addrinfo hints, * res;
+
+	sock->fd = -1;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (host == 0 || getaddrinfo(host, "123", &hints, &res) != 0)
+		return false;
+	sock->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	// Only datagrams from the server are received on a connected socket
+	if (sock->fd >= 0 && (connect(sock->fd, res->ai_addr, res->ai_addrlen) != 0
+		|| fcntl(sock->fd, F_SETFL, fcntl(sock->fd, F_GETFL) | O_NONBLOCK) != 0)) {
+		close(sock->fd);
+		sock->fd = -1;
+	}
+	freeaddrinfo(res);
+	return sock->fd >= 0;
+}
+
+void timelib_sntp_udp_close(struct timelib_sntp_socket * sock)
+{
+	if (sock->fd >= 0)
+		close(sock->fd);
+	sock->fd = -1;
+}
+
+bool timelib_sntp_udp_send(void * ctx, const uint8_t * packet)
+{
+	struct timelib_sntp_socket * sock = (struct timelib_sntp_socket *) ctx;
+
+	if (sock == 0 || sock->fd < 0)
+		return false;
+	return send(sock->fd, packet, TIMELIB_SNTP_PACKET_SIZE, 0) == TIMELIB_SNTP_PACKET_SIZE;
+}
+
+bool timelib_sntp_udp_recv(void * ctx, uint8_t * packet)
+{
+	struct timelib_sntp_socket * sock = (struct timelib_sntp_socket *) ctx;
+
+	if (sock == 0 || sock->fd < 0)
+		return false;
+	return recv(sock->fd, packet, TIMELIB_SNTP_PACKET_SIZE, 0) == TIMELIB_SNTP_PACKET_SIZE;
+}
+#endif
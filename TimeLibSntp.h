@@ -0,0 +1,353 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBSNTP_H
+#define TIMELIBSNTP_H
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include "TimeLib.h"
+
+/*-------------------------------------------------------------*
+ *		Library configuration				*
+ *-------------------------------------------------------------*/
+
+/*
+ * The client and the loopback server take their local timestamps from the
+ * monotonic clock, they are only built with CONFIG_TIMELIB_MONO defined.
+ */
+
+/**
+ * Maximum time in milliseconds to wait for the server reply
+ */
+#define CONFIG_TIMELIB_SNTP_TIMEOUT	1000
+
+/*-------------------------------------------------------------*
+ *		Macros and definitions				*
+ *-------------------------------------------------------------*/
+/**
+ * Size of a SNTP packet without authentication fields
+ */
+#define TIMELIB_SNTP_PACKET_SIZE	48
+
+/**
+ * Seconds between the NTP epoch (1900) and the Unix epoch (1970)
+ */
+#define TIMELIB_NTP_UNIX_OFFSET		2208988800UL
+
+/*-------------------------------------------------------------*
+ *		Typedefs enums & structs			*
+ *-------------------------------------------------------------*/
+
+/**
+ * NTP timestamp: seconds since the start of the NTP era in the upper 32 bits
+ * and the fraction of second in the lower 32 bits
+ */
+typedef uint64_t timelib_ntp_t;
+
+/**
+ * Sends a SNTP request and receives the reply
+ *
+ * The function sends the TIMELIB_SNTP_PACKET_SIZE bytes of the buffer and
+ * overwrites them with the reply. It should return false if the request
+ * cannot be sent or no reply arrives before the timeout (milliseconds).
+ */
+typedef bool (*timelib_sntp_transport_t)(void * ctx, uint8_t * packet, uint16_t timeout);
+
+/**
+ * Sends a SNTP request without waiting for the reply
+ *
+ * The function sends the TIMELIB_SNTP_PACKET_SIZE bytes of the buffer and
+ * should return false if the request cannot be sent.
+ */
+typedef bool (*timelib_sntp_send_t)(void * ctx, const uint8_t * packet);
+
+/**
+ * Receives a SNTP reply without blocking
+ *
+ * The function stores a received reply of TIMELIB_SNTP_PACKET_SIZE bytes on
+ * the buffer. It should return false at once if no reply is waiting.
+ */
+typedef bool (*timelib_sntp_recv_t)(void * ctx, uint8_t * packet);
+
+/**
+ * @brief Result of a SNTP query
+ */
+struct timelib_sntp_sample {
+	timelib_ntp_t t1; //!< Local time when the request was sent
+	timelib_ntp_t t2; //!< Server time when the request arrived
+	timelib_ntp_t t3; //!< Server time when the reply was sent
+	timelib_ntp_t t4; //!< Local time when the reply arrived
+	int64_t offset; //!< Microseconds to add to the local clock to match the server
+	int64_t delay; //!< Round trip delay in microseconds
+	uint8_t stratum; //!< Stratum of the server
+};
+
+#if defined(CONFIG_TIMELIB_MONO)
+/**
+ * @brief State of the loopback SNTP server
+ */
+struct timelib_sntp_server {
+	timelib_t time; //!< Server time at the reference instant
+	uint64_t mono; //!< Monotonic instant when the time was set
+	uint8_t stratum; //!< Stratum reported to clients, 0 sends kiss of death
+	uint32_t requests; //!< Number of requests answered
+	uint8_t reply[TIMELIB_SNTP_PACKET_SIZE]; //!< Reply waiting on the non blocking transport
+	bool ready; //!< A reply is waiting to be received
+};
+#endif
+
+#if defined(TIMELIB_PORT_POSIX)
+/**
+ * @brief Socket of the non blocking UDP transport
+ */
+struct timelib_sntp_socket {
+	int fd; //!< Connected datagram socket, -1 if closed
+};
+#endif
+
+/*-------------------------------------------------------------*
+ *		Function prototypes				*
+ *-------------------------------------------------------------*/
+#ifdef	__cplusplus
+extern "C" {
+#endif
+	/**
+	 * @brief Converts a timestamp to NTP format
+	 *
+	 * Timestamps after 2036-02-07 06:28:16 fall on NTP era 1 and wrap the
+	 * seconds field as specified by RFC 4330.
+	 *
+	 * @param time The Unix timestamp
+	 * @param us Microseconds elapsed on the given second (0 - 999999)
+	 *
+	 * @return The NTP timestamp
+	 */
+	timelib_ntp_t timelib_ntp_from_time(timelib_t time, uint32_t us);
+
+	/**
+	 * @brief Converts a NTP timestamp to Unix time
+	 *
+	 * NTP seconds below TIMELIB_NTP_UNIX_OFFSET are taken as NTP era 1, so
+	 * the full 1970 - 2106 range of timelib_t is covered.
+	 *
+	 * @param ntp The NTP timestamp
+	 * @param us Pointer to store the microseconds part, may be null
+	 *
+	 * @return The Unix timestamp
+	 */
+	timelib_t timelib_ntp_to_time(timelib_ntp_t ntp, uint32_t * us);
+
+	/**
+	 * @brief Gets the interval between two NTP timestamps
+	 *
+	 * The result is correct across an era rollover as long as both
+	 * timestamps are less than 68 years apart.
+	 *
+	 * @param end The later timestamp
+	 * @param start The earlier timestamp
+	 *
+	 * @return Microseconds from start to end, negative if end is earlier
+	 */
+	int64_t timelib_ntp_interval(timelib_ntp_t end, timelib_ntp_t start);
+
+	/**
+	 * @brief Computes offset and round trip delay of a sample
+	 *
+	 * Fills the offset and delay fields from the four timestamps of the
+	 * sample as specified by RFC 4330.
+	 *
+	 * @param sample The sample to update
+	 */
+	void timelib_sntp_compute(struct timelib_sntp_sample * sample);
+
+#if defined(CONFIG_TIMELIB_MONO)
+
+	/**
+	 * @brief Configures the transport used to reach the server
+	 *
+	 * @param transport Function that exchanges a packet with the server
+	 * @param ctx Data passed to the transport: host name, socket, server, etc.
+	 */
+	void timelib_sntp_setup(timelib_sntp_transport_t transport, void * ctx);
+
+	/**
+	 * @brief Gets time from the server
+	 *
+	 * Queries the server and returns its time at the moment the reply arrived
+	 * rounded to the nearest second. Pass this function to timelib_set_provider()
+	 * to use it as the time provider. The call blocks for one round trip, up
+	 * to CONFIG_TIMELIB_SNTP_TIMEOUT milliseconds, and so does the clock read
+	 * that triggers the sync. Use timelib_sntp_request() and
+	 * timelib_sntp_poll() where the application cannot wait.
+	 *
+	 * @return The server time or 0 if the query failed
+	 */
+	timelib_t timelib_sntp_get();
+
+	/**
+	 * @brief Configures the transport of the non blocking mode
+	 *
+	 * Drops any request waiting for its reply.
+	 *
+	 * @param send Function that sends a request
+	 * @param recv Function that receives a reply without blocking
+	 * @param ctx Data passed to both functions
+	 */
+	void timelib_sntp_setup_async(timelib_sntp_send_t send, timelib_sntp_recv_t recv, void * ctx);
+
+	/**
+	 * @brief Sends a request without waiting for the reply
+	 *
+	 * The reply is handled by timelib_sntp_poll(). A new request replaces the
+	 * one waiting, late replies to it are discarded.
+	 *
+	 * @return Returns true if the request was sent
+	 */
+	bool timelib_sntp_request();
+
+	/**
+	 * @brief Checks for the reply to the last request and sets the clock
+	 *
+	 * Never blocks. When a valid reply arrived the clock is set to the server
+	 * time, corrected by half the round trip delay. The time between the
+	 * arrival of the reply and this call counts as network delay, so call it
+	 * often while a request is pending. Requests with no reply after
+	 * CONFIG_TIMELIB_SNTP_TIMEOUT milliseconds are dropped.
+	 *
+	 * Clocks set this way should not have a provider, use this mode instead
+	 * of timelib_sntp_get() and request again when the clock needs sync.
+	 *
+	 * @param clock The clock to set, null for the default clock
+	 *
+	 * @return Returns true if the clock was set
+	 */
+	bool timelib_sntp_poll(struct timelib_clock * clock);
+
+	/**
+	 * @brief Checks if a request is waiting for its reply
+	 *
+	 * @return Returns true while timelib_sntp_poll() has a reply to wait for
+	 */
+	bool timelib_sntp_pending();
+
+	/**
+	 * @brief Queries the server and measures the local clock
+	 *
+	 * Compares the server time against the default clock. Local timestamps
+	 * come from the default clock, so this function must not be called from
+	 * a time provider, use timelib_sntp_get() there.
+	 *
+	 * @param sample Receives the timestamps, offset and delay
+	 *
+	 * @return Returns true if a valid reply was received
+	 */
+	bool timelib_sntp_query(struct timelib_sntp_sample * sample);
+
+	/**
+	 * @brief Initializes a loopback server
+	 *
+	 * The server keeps its own time running on the monotonic clock.
+	 *
+	 * @param server The server to initialize
+	 * @param time The time of the server now
+	 */
+	void timelib_sntp_server_init(struct timelib_sntp_server * server, timelib_t time);
+
+	/**
+	 * @brief Answers a SNTP request
+	 *
+	 * @param server The server answering
+	 * @param packet The request, overwritten with the reply
+	 *
+	 * @return Returns true if the packet was a client request
+	 */
+	bool timelib_sntp_server_reply(struct timelib_sntp_server * server, uint8_t * packet);
+
+	/**
+	 * @brief Transport that answers from a loopback server
+	 *
+	 * Allows testing without network access, pass a pointer to a
+	 * struct timelib_sntp_server as the transport context.
+	 */
+	bool timelib_sntp_loopback(void * ctx, uint8_t * packet, uint16_t timeout);
+
+	/**
+	 * @brief Non blocking transport that sends to a loopback server
+	 *
+	 * The server answers at once and keeps the reply until it is received
+	 * with timelib_sntp_loopback_recv().
+	 */
+	bool timelib_sntp_loopback_send(void * ctx, const uint8_t * packet);
+
+	/**
+	 * @brief Non blocking transport that receives from a loopback server
+	 */
+	bool timelib_sntp_loopback_recv(void * ctx, uint8_t * packet);
+#endif
+
+#if defined(TIMELIB_PORT_POSIX)
+	/**
+	 * @brief Transport that sends the request over UDP
+	 *
+	 * Pass the host name of the server as the transport context.
+	 */
+	bool timelib_sntp_udp(void * ctx, uint8_t * packet, uint16_t timeout);
+
+	/**
+	 * @brief Opens the socket of the non blocking UDP transport
+	 *
+	 * The host name is resolved here, this call may block.
+	 *
+	 * @param sock The socket to open
+	 * @param host Host name of the server
+	 *
+	 * @return Returns true if the socket was opened
+	 */
+	bool timelib_sntp_udp_open(struct timelib_sntp_socket * sock, const char * host);
+
+	/**
+	 * @brief Closes the socket of the non blocking UDP transport
+	 *
+	 * @param sock The socket to close
+	 */
+	void timelib_sntp_udp_close(struct timelib_sntp_socket * sock);
+
+	/**
+	 * @brief Non blocking transport that sends over UDP
+	 *
+	 * Pass a pointer to an open struct timelib_sntp_socket as the context.
+	 */
+	bool timelib_sntp_udp_send(void * ctx, const uint8_t * packet);
+
+	/**
+	 * @brief Non blocking transport that receives over UDP
+	 *
+	 * Pass a pointer to an open struct timelib_sntp_socket as the context.
+	 */
+	bool timelib_sntp_udp_recv(void * ctx, uint8_t * packet);
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
+// End of Header file
@@ -0,0 +1,168 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#include "TimeLibSources.h"
+
+/* Registered time sources, empty slots have a null read function */
+struct timelib_source timelib_sources[CONFIG_TIMELIB_SOURCES_MAX];
+
+/**
+ * Computes how much a reading of the given source counts
+ *
+ * @param src The source
+ *
+ * @return The weight of the source readings
+ */
+static uint32_t timelib_sources_weight(const struct timelib_source * src)
+{
+	uint32_t w;
+
+	// Preferred and reliable sources count more
+	w = (uint32_t) (src->score + 1) * (uint32_t) (8 - (src->priority < 7 ? src->priority : 7));
+	// Fast sources count more, a one second latency halves the weight
+	w = (w * 256UL) / (16UL + (uint32_t) ((src->latency * 16UL) / TICK_SECOND));
+	return(w != 0) ? w : 1;
+}
+
+/*-------------------------------------------------------------*
+ *	Public API, check TimeLibSources.h for documentation	*
+ *-------------------------------------------------------------*/
+bool timelib_sources_add(timelib_callback_t read, uint8_t priority)
+{
+	uint8_t i, slot = CONFIG_TIMELIB_SOURCES_MAX;
+
+	// Check null pointer
+	if (read == 0)
+		return false;
+	for (i = 0; i < CONFIG_TIMELIB_SOURCES_MAX; i++) {
+		if (timelib_sources[i].read == read) {
+			timelib_sources[i].priority = priority;
+			return true;
+		}
+		if (timelib_sources[i].read == 0 && slot == CONFIG_TIMELIB_SOURCES_MAX)
+			slot = i;
+	}
+	if (slot == CONFIG_TIMELIB_SOURCES_MAX)
+		return false;
+	timelib_sources[slot].read = read;
+	timelib_sources[slot].priority = priority;
+	timelib_sources[slot].score = TIMELIB_SOURCES_SCORE_INIT;
+	timelib_sources[slot].latency = 0;
+	timelib_sources[slot].last = 0;
+	return true;
+}
+
+void timelib_sources_remove(timelib_callback_t read)
+{
+	uint8_t i;
+
+	for (i = 0; i < CONFIG_TIMELIB_SOURCES_MAX; i++) {
+		if (timelib_sources[i].read == read)
+			timelib_sources[i].read = 0;
+	}
+}
+
+timelib_t timelib_sources_get()
+{
+	unsigned long mid[CONFIG_TIMELIB_SOURCES_MAX];
+	unsigned long start, end;
+	uint32_t weight[CONFIG_TIMELIB_SOURCES_MAX];
+	uint32_t support, best_support = 0, sum;
+	int32_t diff, acc;
+	uint8_t i, j, agree, registered = 0, best = CONFIG_TIMELIB_SOURCES_MAX;
+
+	// Read every source, sources are blocking so they are queried in turn
+	for (i = 0; i < CONFIG_TIMELIB_SOURCES_MAX; i++) {
+		timelib_sources[i].last = 0;
+		if (timelib_sources[i].read == 0)
+			continue;
+		registered++;
+		start = timelib_get_ticks();
+		timelib_sources[i].last = timelib_sources[i].read();
+		end = timelib_get_ticks();
+		mid[i] = start + (end - start) / 2;
+		timelib_sources[i].latency += ((long) (end - start) - (long) timelib_sources[i].latency) / 4;
+		if (timelib_sources[i].last == 0 && timelib_sources[i].score > 0)
+			timelib_sources[i].score--;
+	}
+
+	// Move readings to the instant the last source answered
+	end = timelib_get_ticks();
+	for (i = 0; i < CONFIG_TIMELIB_SOURCES_MAX; i++) {
+		if (timelib_sources[i].last == 0)
+			continue;
+		timelib_sources[i].last += (timelib_t) ((end - mid[i] + TICK_SECOND / 2) / TICK_SECOND);
+		weight[i] = timelib_sources_weight(&timelib_sources[i]);
+	}
+
+	// Find the reading supported by the largest weight of agreeing readings,
+	// only groups with most of the registered sources can win, so a lone
+	// source cannot step the clock while the others are silent
+	for (i = 0; i < CONFIG_TIMELIB_SOURCES_MAX; i++) {
+		if (timelib_sources[i].last == 0)
+			continue;
+		support = 0;
+		agree = 0;
+		for (j = 0; j < CONFIG_TIMELIB_SOURCES_MAX; j++) {
+			if (timelib_sources[j].last == 0)
+				continue;
+			diff = (int32_t) (timelib_sources[j].last - timelib_sources[i].last);
+			if (diff >= -CONFIG_TIMELIB_SOURCES_TOLERANCE && diff <= CONFIG_TIMELIB_SOURCES_TOLERANCE) {
+				support += weight[j];
+				agree++;
+			}
+		}
+		if (agree * 2 <= registered)
+			continue;
+		if (support > best_support || (support == best_support && best != CONFIG_TIMELIB_SOURCES_MAX
+			&& timelib_sources[i].priority < timelib_sources[best].priority)) {
+			best_support = support;
+			best = i;
+		}
+	}
+	// No answer or no majority, do not step the clock on a tie
+	if (best == CONFIG_TIMELIB_SOURCES_MAX)
+		return 0;
+
+	// Weighted mean of the agreeing readings, outliers lose reliability
+	sum = 0;
+	acc = 0;
+	for (j = 0; j < CONFIG_TIMELIB_SOURCES_MAX; j++) {
+		if (timelib_sources[j].last == 0)
+			continue;
+		diff = (int32_t) (timelib_sources[j].last - timelib_sources[best].last);
+		if (diff >= -CONFIG_TIMELIB_SOURCES_TOLERANCE && diff <= CONFIG_TIMELIB_SOURCES_TOLERANCE) {
+			acc += diff * (int32_t) weight[j];
+			sum += weight[j];
+			if (timelib_sources[j].score < 15)
+				timelib_sources[j].score++;
+		} else {
+			timelib_sources[j].score = (timelib_sources[j].score > 4) ? timelib_sources[j].score - 4 : 0;
+		}
+	}
+	acc += (acc >= 0) ? (int32_t) (sum / 2) : -(int32_t) (sum / 2);
+	return timelib_sources[best].last + (timelib_t) (acc / (int32_t) sum);
+}
+
+const struct timelib_source * timelib_sources_info(uint8_t index)
+{
+	if (index >= CONFIG_TIMELIB_SOURCES_MAX || timelib_sources[index].read == 0)
+		return 0;
+	return &timelib_sources[index];
+}
@@ -0,0 +1,123 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBSOURCES_H
+#define TIMELIBSOURCES_H
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include "TimeLib.h"
+
+/*-------------------------------------------------------------*
+ *		Library configuration				*
+ *-------------------------------------------------------------*/
+
+/**
+ * Maximum number of time sources that can be registered
+ */
+#define CONFIG_TIMELIB_SOURCES_MAX	4
+
+/**
+ * Maximum difference in seconds between two readings that agree
+ */
+#define CONFIG_TIMELIB_SOURCES_TOLERANCE	2
+
+/*-------------------------------------------------------------*
+ *		Macros and definitions				*
+ *-------------------------------------------------------------*/
+/**
+ * Reliability score of a newly registered source (0 - 15)
+ */
+#define TIMELIB_SOURCES_SCORE_INIT	8
+
+/*-------------------------------------------------------------*
+ *		Typedefs enums & structs			*
+ *-------------------------------------------------------------*/
+
+/**
+ * @brief State of a registered time source
+ */
+struct timelib_source {
+	timelib_callback_t read; //!< Function that gets time from the source
+	uint8_t priority; //!< Preference of the source, 0 is the most preferred
+	uint8_t score; //!< Reliability of the source (0 - 15)
+	unsigned long latency; //!< Smoothed duration of a reading in ticks
+	timelib_t last; //!< Last reading adjusted to the end of the query, 0 if failed
+};
+
+/*-------------------------------------------------------------*
+ *		Function prototypes				*
+ *-------------------------------------------------------------*/
+#ifdef	__cplusplus
+extern "C" {
+#endif
+	/**
+	 * @brief Registers a time source
+	 *
+	 * Registering an already registered function updates its priority.
+	 *
+	 * @param read Function that gets time from the source: GPS, NTP, RTC, etc.
+	 * It should return 0 when the source cannot provide time.
+	 * @param priority Preference of the source, 0 is the most preferred
+	 *
+	 * @return Returns true if the source was registered, false if there is no
+	 * room for more sources
+	 */
+	bool timelib_sources_add(timelib_callback_t read, uint8_t priority);
+
+	/**
+	 * @brief Removes a time source
+	 *
+	 * @param read Function given when the source was registered
+	 */
+	void timelib_sources_remove(timelib_callback_t read);
+
+	/**
+	 * @brief Queries all the registered sources and selects the time
+	 *
+	 * Each source is read once, readings are adjusted to the time when the
+	 * last source answered and then grouped: readings that agree within
+	 * CONFIG_TIMELIB_SOURCES_TOLERANCE support each other with a weight based
+	 * on the source priority, reliability score and latency. Only groups
+	 * holding more than half of the registered sources are candidates, a
+	 * source that does not answer counts against every group. The candidate
+	 * with the largest weight wins and outliers lose reliability. Pass this function
+	 * to timelib_set_provider() to use it as the time provider.
+	 *
+	 * @return The selected timestamp or 0 if no group of readings has the
+	 * majority of the registered sources
+	 */
+	timelib_t timelib_sources_get();
+
+	/**
+	 * @brief Gets the state of a registered source
+	 *
+	 * @param index Index of the source (0 - CONFIG_TIMELIB_SOURCES_MAX - 1)
+	 *
+	 * @return Pointer to the source state or null if the slot is empty
+	 */
+	const struct timelib_source * timelib_sources_info(uint8_t index);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
+// End of Header file
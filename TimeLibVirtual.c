@@ -0,0 +1,127 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#include "TimeLibVirtual.h"
+
+/* Simulated tick counter */
+unsigned long vtick = 0;
+
+/* Trace being replayed or recorded */
+const unsigned long * vtrace = 0;
+unsigned long * vrecord = 0;
+size_t vtrace_size = 0;
+size_t vtrace_pos = 0;
+
+/**
+ * Tick source for simulated time
+ *
+ * @return The simulated tick count
+ */
+static unsigned long timelib_virtual_source()
+{
+	return vtick;
+}
+
+/**
+ * Tick source that replays a trace
+ *
+ * @return The next tick count on the trace
+ */
+static unsigned long timelib_virtual_replay_source()
+{
+	if (vtrace_pos < vtrace_size)
+		vtick = vtrace[vtrace_pos++];
+	return vtick;
+}
+
+/**
+ * Tick source that records the port tick counter
+ *
+ * @return The tick count of the port
+ */
+static unsigned long timelib_virtual_record_source()
+{
+	vtick = (unsigned long) tick_get();
+	if (vtrace_pos < vtrace_size)
+		vrecord[vtrace_pos++] = vtick;
+	return vtick;
+}
+
+/*-------------------------------------------------------------*
+ *	Public API, check TimeLibVirtual.h for documentation	*
+ *-------------------------------------------------------------*/
+void timelib_virtual_start(unsigned long tick)
+{
+	vtick = tick;
+	timelib_set_tick_source(timelib_virtual_source);
+}
+
+void timelib_virtual_replay(const unsigned long * trace, size_t count)
+{
+	vtrace = trace;
+	vtrace_size = count;
+	vtrace_pos = 0;
+	vtick = (count != 0) ? trace[0] : 0;
+	timelib_set_tick_source(timelib_virtual_replay_source);
+}
+
+void timelib_virtual_record(unsigned long * trace, size_t size)
+{
+	vrecord = trace;
+	vtrace_size = size;
+	vtrace_pos = 0;
+	timelib_set_tick_source(timelib_virtual_record_source);
+}
+
+void timelib_virtual_stop()
+{
+	timelib_set_tick_source(0);
+}
+
+unsigned long timelib_virtual_ticks()
+{
+	return vtick;
+}
+
+size_t timelib_virtual_position()
+{
+	return vtrace_pos;
+}
+
+void timelib_virtual_step(unsigned long ticks)
+{
+	vtick += ticks;
+}
+
+void timelib_virtual_forward(struct timelib_clock * clocks, size_t count, unsigned long ticks, unsigned long step)
+{
+	unsigned long n;
+
+	if (step == 0)
+		step = (unsigned long) TICK_SECOND;
+	while (ticks != 0) {
+		n = (ticks < step) ? ticks : step;
+		vtick += n;
+		ticks -= n;
+		if (clocks == 0)
+			timelib_get();
+		else
+			timelib_clock_advance_all(clocks, count);
+	}
+}
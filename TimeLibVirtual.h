@@ -0,0 +1,115 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBVIRTUAL_H
+#define TIMELIBVIRTUAL_H
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include "TimeLib.h"
+
+/*-------------------------------------------------------------*
+ *		Function prototypes				*
+ *-------------------------------------------------------------*/
+#ifdef	__cplusplus
+extern "C" {
+#endif
+	/**
+	 * @brief Drives the clocks with a simulated tick counter
+	 *
+	 * Installs a tick source that only moves when timelib_virtual_step() or
+	 * timelib_virtual_forward() are called, this way tests of the sync logic
+	 * run faster than real time and give the same result on every run.
+	 *
+	 * @param tick Initial value of the simulated tick counter
+	 */
+	void timelib_virtual_start(unsigned long tick);
+
+	/**
+	 * @brief Drives the clocks with a recorded sequence of tick readings
+	 *
+	 * Each read of the tick counter returns the next element of the trace,
+	 * once the trace is exhausted the last value is repeated.
+	 *
+	 * @param trace Array of tick readings, must remain valid while replaying
+	 * @param count Number of elements on the trace
+	 */
+	void timelib_virtual_replay(const unsigned long * trace, size_t count);
+
+	/**
+	 * @brief Records the tick readings done by the library
+	 *
+	 * The port tick counter keeps driving the clocks and every reading is
+	 * stored on the trace until it is full. The trace can be replayed later
+	 * with timelib_virtual_replay().
+	 *
+	 * @param trace Array that receives the tick readings
+	 * @param size Number of elements of the trace array
+	 */
+	void timelib_virtual_record(unsigned long * trace, size_t size);
+
+	/**
+	 * @brief Restores the port tick counter
+	 */
+	void timelib_virtual_stop();
+
+	/**
+	 * @brief Gets the current value of the simulated tick counter
+	 *
+	 * @return The simulated tick count
+	 */
+	unsigned long timelib_virtual_ticks();
+
+	/**
+	 * @brief Gets the number of trace elements read or recorded
+	 *
+	 * @return The position on the trace being replayed or recorded
+	 */
+	size_t timelib_virtual_position();
+
+	/**
+	 * @brief Advances the simulated tick counter
+	 *
+	 * Clocks are not updated, they catch up on the next read.
+	 *
+	 * @param ticks Number of ticks to advance
+	 */
+	void timelib_virtual_step(unsigned long ticks);
+
+	/**
+	 * @brief Advances the simulated tick counter updating clocks on the way
+	 *
+	 * The counter advances in increments of the given step and the clocks
+	 * are updated after each increment, so provider syncs happen at the same
+	 * simulated time they would happen on a real device polled that often.
+	 *
+	 * @param clocks Array of clocks to update, null to update the default clock
+	 * @param count Number of clocks on the array
+	 * @param ticks Total number of ticks to advance
+	 * @param step Ticks between clock updates, 0 to update once per second
+	 */
+	void timelib_virtual_forward(struct timelib_clock * clocks, size_t count, unsigned long ticks, unsigned long step);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
+// End of Header file
@@ -46,7 +46,7 @@ void main()
 	struct tm tinfo;
 
 	// Local time to get
-	timelib_t now;
+	struct timelib_tm tnow;
 
 	// Store last time we sent the information
 	uint32_t last = 0;
@@ -76,8 +76,10 @@ void main()
 		// Display the time every second
 		if (tick_get() - last > TICK_SECOND) {
 			last = tick_get();
+			// Read all the time fields at once so they belong to the same second
+			timelib_now_tm(&tnow, NULL);
 			// Send to serial port
-			printf("Time: %02d:%02d:%02d Date: %02d/%02d/%02d\r\n", hour(), minute(), second(), day(), month(), year());
+			printf("Time: %02d:%02d:%02d Date: %02d/%02d/%02d\r\n", tnow.tm_hour, tnow.tm_min, tnow.tm_sec, tnow.tm_mday, tnow.tm_mon, timelib_tm2y2k(tnow.tm_year));
 		}
 	}
 
@@ -47,10 +47,8 @@ void loop()
   if (millis() - last > 1000) {
     // Keep track of the time we last sent data to serial monitor
     last = millis();
-    // Get the timestamp from the library
-    now = timelib_get();
-    // Convert to human readable format
-    timelib_break(now, &tinfo);
+    // Get the timestamp and its human readable format at once
+    now = timelib_now_tm(&tinfo, NULL);
     // Send to serial port
     Serial.print(tinfo.tm_hour);
     printDigits(tinfo.tm_min);
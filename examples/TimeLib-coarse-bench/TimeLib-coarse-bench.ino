@@ -0,0 +1,72 @@
+/**
+   GeekFactory - "Construye tu propia tecnologia"
+   Distribucion de materiales para el desarrollo e innovacion tecnologica
+   www.geekfactory.mx
+
+   Benchmark of the TimeLib coarse clock. This code measures how many times per
+   second the time can be read using the standard timelib_get() path and the
+   coarse timelib_get_coarse() path and prints the results on the serial monitor.
+   Enable CONFIG_TIMELIB_COARSE on TimeLib.h to measure the coarse path, without
+   it only the standard path is measured.
+*/
+#include "TimeLib.h"
+
+// Number of reads on each measurement round
+#define READS_PER_ROUND 10000UL
+
+// Keep the compiler from optimizing away the reads
+volatile timelib_t sink;
+#if defined(CONFIG_TIMELIB_COARSE)
+// Store last time we updated the coarse clock
+uint32_t last = 0;
+#endif
+
+void setup()
+{
+  // Configure serial port
+  Serial.begin(115200);
+  while (!Serial);
+
+  // Set time to 13:55:30 Jan 1st 2014 and publish the first coarse value
+  timelib_set(1388584530UL);
+#if defined(CONFIG_TIMELIB_COARSE)
+  timelib_coarse_tick();
+#endif
+}
+
+void loop()
+{
+  uint32_t start, standard;
+  uint32_t i;
+
+  // Measure the standard path
+  start = micros();
+  for (i = 0; i < READS_PER_ROUND; i++)
+    sink = timelib_get();
+  standard = micros() - start;
+
+  Serial.print("timelib_get(): ");
+  Serial.print((READS_PER_ROUND * 1000UL) / (standard / 1000UL + 1));
+
+#if defined(CONFIG_TIMELIB_COARSE)
+  uint32_t coarse;
+
+  // Measure the coarse path, the ticker runs between rounds
+  start = micros();
+  for (i = 0; i < READS_PER_ROUND; i++)
+    sink = timelib_get_coarse();
+  coarse = micros() - start;
+
+  // Drive the coarse clock, an application would do this from a timer interrupt
+  if (millis() - last >= 100) {
+    last = millis();
+    timelib_coarse_tick();
+  }
+
+  Serial.print(" reads/s timelib_get_coarse(): ");
+  Serial.print((READS_PER_ROUND * 1000UL) / (coarse / 1000UL + 1));
+  Serial.println(" reads/s");
+#else
+  Serial.println(" reads/s timelib_get_coarse(): disabled, enable CONFIG_TIMELIB_COARSE");
+#endif
+}
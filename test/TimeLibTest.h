@@ -0,0 +1,84 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+#ifndef TIMELIBTEST_H
+#define TIMELIBTEST_H
+
+/*
+ * Minimal checks for the host test programs, each program prints the failed
+ * checks and returns a non zero exit code if any of them failed.
+ */
+
+/*-------------------------------------------------------------*
+ *		Includes and dependencies			*
+ *-------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdio.h>
+
+/*-------------------------------------------------------------*
+ *		Macros and definitions				*
+ *-------------------------------------------------------------*/
+
+/* Number of failed checks on the running program */
+static unsigned int test_failures = 0;
+/* Pseudo random generator state, fixed seed so runs are repeatable */
+static uint32_t test_seed = 12345;
+
+/**
+ * Checks a condition and reports it if it does not hold
+ */
+#define TEST_CHECK(cond) do { \
+		if (!(cond)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while (0)
+
+/**
+ * Checks that two unsigned values are equal and reports both if not
+ */
+#define TEST_EQUAL(a, b) do { \
+		unsigned long long test_a = (unsigned long long) (a), test_b = (unsigned long long) (b); \
+		if (test_a != test_b) { \
+			printf("%s:%d: %s == %s failed: %llu != %llu\n", __FILE__, __LINE__, #a, #b, test_a, test_b); \
+			test_failures++; \
+		} \
+	} while (0)
+
+/**
+ * Prints the result of the program and gives the exit code for main()
+ */
+#define TEST_RESULT(name) \
+	(printf("%s: %s\n", (name), test_failures == 0 ? "passed" : "FAILED"), test_failures == 0 ? 0 : 1)
+
+/*-------------------------------------------------------------*
+ *		Function definitions				*
+ *-------------------------------------------------------------*/
+
+/**
+ * Gets the next number of a repeatable pseudo random sequence
+ */
+static inline uint32_t test_random()
+{
+	test_seed = test_seed * 1103515245UL + 12345UL;
+	return test_seed >> 8;
+}
+
+#endif
+// End of Header file
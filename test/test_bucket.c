@@ -0,0 +1,142 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Calendar bucket indexes and histograms checked against timelib_break().
+ */
+#include "TimeLibBucket.h"
+#include "TimeLibTest.h"
+
+/* Number of timestamps on each test */
+#define BUCKET_COUNT	20000
+/* Number of buckets of the histograms */
+#define BUCKET_SLOTS	64
+
+/**
+ * Computes the bucket of a timestamp from its broken down fields
+ */
+static uint32_t reference_index(timelib_t time, enum timelib_bucket_unit unit, int32_t offset)
+{
+	struct timelib_tm tm;
+	uint32_t day;
+
+	time += (timelib_t) offset;
+	timelib_break(time, &tm);
+	day = time / TIMELIB_SECS_PER_DAY;
+	switch (unit) {
+	case E_TIMELIB_BUCKET_HOUR:
+		return day * 24 + tm.tm_hour;
+	case E_TIMELIB_BUCKET_DAY:
+		return day;
+	case E_TIMELIB_BUCKET_WEEK:
+		// Monday of the week, week 0 starts on Monday Dec 29, 1969
+		return(day + 3 - (uint32_t) ((tm.tm_wday + 5) % 7)) / 7;
+	default:
+		return(uint32_t) tm.tm_year * 12 + tm.tm_mon - 1;
+	}
+}
+
+/**
+ * Fills an array with random timestamps, the local time of every one of them
+ * falls after the epoch
+ */
+static void random_times(timelib_t * times, size_t count, timelib_t first, timelib_t span)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		times[i] = first + (timelib_t) ((((uint64_t) test_random() << 24) ^ test_random()) % span);
+}
+
+/**
+ * Checks the bucket indexes of every unit and several offsets
+ */
+static void test_index()
+{
+	static const int32_t offsets[] = {0, 3600, -6 * 3600, 5 * 3600 + 1800, 14 * 3600};
+	static timelib_t times[BUCKET_COUNT];
+	static uint32_t index[BUCKET_COUNT];
+	static const timelib_t fixed[] = {0, 10, 100000, 300000, 345599, 345600};
+	static const uint32_t weeks[] = {0, 0, 0, 0, 0, 1};
+	unsigned int u, o;
+	size_t i;
+
+	// The first days of 1970 fall on week 0 until Sunday Jan 4
+	timelib_bucket_index(fixed, index, 6, E_TIMELIB_BUCKET_WEEK, 0);
+	for (i = 0; i < 6; i++)
+		TEST_EQUAL(index[i], weeks[i]);
+
+	random_times(times, BUCKET_COUNT, TIMELIB_SECS_PER_DAY, 0xFFFFFFFFUL - 2 * TIMELIB_SECS_PER_DAY);
+	for (u = E_TIMELIB_BUCKET_HOUR; u <= E_TIMELIB_BUCKET_MONTH; u++) {
+		for (o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+			timelib_bucket_index(times, index, BUCKET_COUNT, (enum timelib_bucket_unit) u, offsets[o]);
+			for (i = 0; i < BUCKET_COUNT; i++)
+				TEST_EQUAL(index[i], reference_index(times[i], (enum timelib_bucket_unit) u, offsets[o]));
+		}
+	}
+}
+
+/**
+ * Checks the histograms against counting the reference indexes one by one
+ */
+static void test_count()
+{
+	static timelib_t times[BUCKET_COUNT];
+	uint32_t counts[BUCKET_SLOTS], expect[BUCKET_SLOTS], first, index;
+	size_t counted, total;
+	unsigned int u, i;
+	timelib_t start = 1500000000UL;
+
+	for (u = E_TIMELIB_BUCKET_HOUR; u <= E_TIMELIB_BUCKET_MONTH; u++) {
+		// Spread the timestamps over a few more buckets than counted
+		random_times(times, BUCKET_COUNT, start, (u == E_TIMELIB_BUCKET_HOUR ? 80UL * 3600
+			: u == E_TIMELIB_BUCKET_DAY ? 80UL * 86400 : u == E_TIMELIB_BUCKET_WEEK ? 560UL * 86400 : 2400UL * 86400));
+		first = reference_index(start, (enum timelib_bucket_unit) u, -6 * 3600) + 2;
+		for (i = 0; i < BUCKET_SLOTS; i++)
+			expect[i] = 0;
+		total = 0;
+		for (i = 0; i < BUCKET_COUNT; i++) {
+			index = reference_index(times[i], (enum timelib_bucket_unit) u, -6 * 3600);
+			if (index >= first && index - first < BUCKET_SLOTS) {
+				expect[index - first]++;
+				total++;
+			}
+		}
+
+		for (i = 0; i < BUCKET_SLOTS; i++)
+			counts[i] = 0;
+		counted = timelib_bucket_count(times, BUCKET_COUNT, (enum timelib_bucket_unit) u, -6 * 3600, first, counts, BUCKET_SLOTS);
+		TEST_EQUAL(counted, total);
+		for (i = 0; i < BUCKET_SLOTS; i++)
+			TEST_EQUAL(counts[i], expect[i]);
+
+		// The parallel version adds to the same histogram
+		counted = timelib_bucket_count_parallel(times, BUCKET_COUNT, (enum timelib_bucket_unit) u, -6 * 3600, first, counts, BUCKET_SLOTS, 4);
+		TEST_EQUAL(counted, total);
+		for (i = 0; i < BUCKET_SLOTS; i++)
+			TEST_EQUAL(counts[i], 2 * expect[i]);
+	}
+}
+
+int main()
+{
+	test_index();
+	test_count();
+	return TEST_RESULT("test_bucket");
+}
@@ -0,0 +1,113 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Business day counting and addition checked against a day by day walk.
+ */
+#include "TimeLibCalendar.h"
+#include "TimeLibTest.h"
+
+/**
+ * Checks business day counting and addition against a day by day walk
+ */
+static void test_calendar()
+{
+	struct timelib_calendar_year years[3];
+	struct timelib_calendar cal;
+	struct timelib_tm tinfo;
+	timelib_t holidays[2], start, day, end;
+	int32_t walk, n;
+
+	// 2023 to 2025 with new year and christmas 2024 as holidays
+	timelib_calendar_init(&cal, years, 3, 53, TIMELIB_WEEKEND_SAT_SUN);
+	tinfo.tm_hour = 12;
+	tinfo.tm_min = 0;
+	tinfo.tm_sec = 0;
+	tinfo.tm_year = 54;
+	tinfo.tm_mon = 1;
+	tinfo.tm_mday = 1;
+	holidays[0] = timelib_make(&tinfo);
+	tinfo.tm_mon = 12;
+	tinfo.tm_mday = 25;
+	holidays[1] = timelib_make(&tinfo);
+	timelib_calendar_set_holidays(&cal, holidays, 2);
+	TEST_CHECK(!timelib_calendar_is_business(&cal, holidays[0]));
+	TEST_CHECK(!timelib_calendar_is_business(&cal, holidays[1]));
+	TEST_CHECK(timelib_calendar_is_business(&cal, holidays[0] + TIMELIB_SECS_PER_DAY));
+
+	// Count from a fixed start to every day of the covered years and beyond
+	tinfo.tm_year = 53;
+	tinfo.tm_mon = 1;
+	tinfo.tm_mday = 1;
+	start = timelib_make(&tinfo);
+	walk = 0;
+	for (day = start; day < start + 4 * 366 * TIMELIB_SECS_PER_DAY; day += TIMELIB_SECS_PER_DAY) {
+		TEST_EQUAL(timelib_calendar_count(&cal, start, day), walk);
+		TEST_EQUAL(timelib_calendar_count(&cal, day, start), -walk);
+		if (timelib_calendar_is_business(&cal, day)) {
+			// Adding the count to the start lands on this day
+			end = timelib_calendar_add(&cal, start, walk);
+			TEST_EQUAL(end, day);
+			walk++;
+		}
+	}
+
+	// Round trip of additions in both directions
+	for (n = -300; n <= 300; n += 7) {
+		end = timelib_calendar_add(&cal, holidays[0] + TIMELIB_SECS_PER_DAY, n);
+		TEST_CHECK(timelib_calendar_is_business(&cal, end));
+		TEST_EQUAL(timelib_calendar_count(&cal, holidays[0] + TIMELIB_SECS_PER_DAY, end), n);
+	}
+}
+
+/**
+ * Checks that additions saturate on both ends of the timestamp range
+ */
+static void test_saturate()
+{
+	struct timelib_calendar_year years[1];
+	struct timelib_calendar cal;
+	timelib_t tod, day, end;
+
+	timelib_calendar_init(&cal, years, 1, 53, TIMELIB_WEEKEND_SAT_SUN);
+	for (tod = 0; tod < TIMELIB_SECS_PER_DAY; tod += 3607) {
+		// Last business day where the time of the day fits, walking back
+		day = (0xFFFFFFFFUL - tod) / TIMELIB_SECS_PER_DAY * TIMELIB_SECS_PER_DAY;
+		while (!timelib_calendar_is_business(&cal, day))
+			day -= TIMELIB_SECS_PER_DAY;
+		end = timelib_calendar_add(&cal, day - 10 * TIMELIB_SECS_PER_DAY + tod, 100);
+		TEST_EQUAL(end, day + tod);
+		end = timelib_calendar_add(&cal, 1700000000UL - 1700000000UL % TIMELIB_SECS_PER_DAY + tod, 0x7FFFFFFFL);
+		TEST_EQUAL(end, day + tod);
+
+		// First business day after the epoch, walking forward
+		day = 0;
+		while (!timelib_calendar_is_business(&cal, day))
+			day += TIMELIB_SECS_PER_DAY;
+		end = timelib_calendar_add(&cal, 1700000000UL - 1700000000UL % TIMELIB_SECS_PER_DAY + tod, -1000000L);
+		TEST_EQUAL(end, day + tod);
+	}
+}
+
+int main()
+{
+	test_calendar();
+	test_saturate();
+	return TEST_RESULT("test_calendar");
+}
@@ -0,0 +1,174 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Drift estimate and warm start from a checkpoint on simulated time. Build
+ * with CONFIG_TIMELIB_CHECKPOINT defined.
+ */
+#include "TimeLibVirtual.h"
+#include "TimeLibTest.h"
+
+#include <stdio.h>
+
+#if !defined(CONFIG_TIMELIB_CHECKPOINT)
+#error "Define CONFIG_TIMELIB_CHECKPOINT to build this test"
+#endif
+
+/* Reference time at tick zero */
+#define REFERENCE	1500000000UL
+/* File that holds the checkpoints written by the test */
+#define CHECKPOINT_FILE	"test_checkpoint.bin"
+
+/* Make the provider fail */
+static bool provider_down = false;
+/* Reference runs this many ticks slower per million than the local ticks */
+static unsigned long provider_ppm = 1000;
+/* Seconds added to the provider time, simulates a stepped reference */
+static timelib_t provider_offset = 0;
+
+/**
+ * Time provider that runs slower than the simulated tick counter
+ */
+static timelib_t provider()
+{
+	unsigned long ticks = timelib_virtual_ticks();
+
+	if (provider_down)
+		return 0;
+	ticks -= (unsigned long) (((unsigned long long) ticks * provider_ppm) / 1000000ULL);
+	return REFERENCE + provider_offset + (timelib_t) (ticks / TICK_SECOND);
+}
+
+/**
+ * The same provider for clock instances
+ */
+static timelib_t clock_provider(struct timelib_clock * clock)
+{
+	(void) clock;
+	return provider();
+}
+
+/**
+ * Checks that the drift estimate is close to the provider drift
+ */
+static bool drift_sane(const struct timelib_clock * clock)
+{
+	return clock->drift >= (int32_t) provider_ppm * 3 / 4 && clock->drift <= (int32_t) provider_ppm * 5 / 4;
+}
+
+/**
+ * Checks the warm start from a checkpoint
+ */
+static void test_restore()
+{
+	timelib_t saved, truth;
+
+	remove(CHECKPOINT_FILE);
+	timelib_virtual_start(0);
+	timelib_storage_file(CHECKPOINT_FILE, 0);
+	TEST_CHECK(!timelib_restore());
+
+	// Learn the drift of the tick counter against the provider
+	timelib_set_provider(provider, TIMELIB_SECS_PER_HOUR);
+	timelib_virtual_forward(0, 0, 48 * TIMELIB_SECS_PER_HOUR * TICK_SECOND, 60 * TICK_SECOND);
+	TEST_EQUAL(timelib_get_status(), E_TIME_OK);
+
+	// Run half an hour on the local ticks and save
+	timelib_virtual_step(TIMELIB_SECS_PER_HOUR / 2 * TICK_SECOND);
+	TEST_CHECK(timelib_checkpoint(true));
+	saved = timelib_get();
+	truth = provider();
+	TEST_CHECK(saved > truth);
+
+	// Restore on a cold clock, halted so the failing provider is not called
+	// yet, the drift estimate removes the local error
+	provider_down = true;
+	timelib_set(0);
+	timelib_halt_clock();
+	TEST_CHECK(timelib_restore());
+	TEST_EQUAL(timelib_get_status(), E_TIME_RESTORED);
+	TEST_CHECK(timelib_get() < saved);
+	TEST_CHECK(timelib_get() >= truth - 1 && timelib_get() <= truth + 1);
+	timelib_resume_clock();
+
+	// The restored clock syncs at once, failures keep the restored status
+	timelib_get();
+	TEST_EQUAL(timelib_get_status(), E_TIME_RESTORED);
+	provider_down = false;
+	timelib_virtual_forward(0, 0, TIMELIB_SECS_PER_HOUR * TICK_SECOND, 0);
+	TEST_EQUAL(timelib_get_status(), E_TIME_OK);
+	TEST_EQUAL(timelib_get(), provider());
+
+	timelib_set_storage(0);
+	remove(CHECKPOINT_FILE);
+	timelib_virtual_stop();
+}
+
+/**
+ * Checks that the built in backends only keep the default clock
+ */
+static void test_instances()
+{
+	struct timelib_clock clock;
+
+	timelib_clock_init(&clock);
+	timelib_clock_set(&clock, REFERENCE);
+	timelib_storage_file(CHECKPOINT_FILE, 0);
+	TEST_CHECK(!timelib_clock_checkpoint(&clock, true));
+	TEST_CHECK(!timelib_clock_restore(&clock));
+	timelib_set_storage(0);
+	remove(CHECKPOINT_FILE);
+}
+
+/**
+ * Checks that times not coming from a provider sync do not count as drift
+ */
+static void test_drift()
+{
+	struct timelib_clock clock;
+
+	timelib_virtual_start(0);
+	timelib_clock_init(&clock);
+	timelib_clock_set_provider(&clock, clock_provider, TIMELIB_SECS_PER_HOUR);
+	timelib_virtual_forward(&clock, 1, 48 * TIMELIB_SECS_PER_HOUR * TICK_SECOND, 60 * TICK_SECOND);
+	TEST_CHECK(drift_sane(&clock));
+
+	// Setting the clock by hand between syncs, a small step would still look
+	// like a plausible drift
+	timelib_virtual_forward(&clock, 1, TIMELIB_SECS_PER_HOUR / 2 * TICK_SECOND, 60 * TICK_SECOND);
+	timelib_clock_set(&clock, timelib_clock_get(&clock) + 20);
+	TEST_EQUAL(clock.last_sync, 0);
+	timelib_virtual_forward(&clock, 1, 3 * TIMELIB_SECS_PER_HOUR * TICK_SECOND, 60 * TICK_SECOND);
+	TEST_CHECK(drift_sane(&clock));
+
+	// A reference that steps gives implausible samples that are dropped
+	provider_offset = 120;
+	timelib_virtual_forward(&clock, 1, 3 * TIMELIB_SECS_PER_HOUR * TICK_SECOND, 60 * TICK_SECOND);
+	TEST_CHECK(drift_sane(&clock));
+	provider_offset = 0;
+	timelib_virtual_stop();
+}
+
+int main()
+{
+	test_restore();
+	test_drift();
+	test_instances();
+	return TEST_RESULT("test_checkpoint");
+}
@@ -0,0 +1,196 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Sync and status transitions of the clocks on simulated time.
+ */
+#include "TimeLibVirtual.h"
+#include "TimeLibTest.h"
+
+/* Reference time at tick zero */
+#define REFERENCE	1500000000UL
+
+/* Make the provider fail */
+static bool provider_down = false;
+/* Number of provider calls */
+static unsigned int provider_calls = 0;
+
+/**
+ * Time provider that follows the simulated tick counter
+ */
+static timelib_t provider()
+{
+	provider_calls++;
+	if (provider_down)
+		return 0;
+	return REFERENCE + (timelib_t) (timelib_virtual_ticks() / TICK_SECOND);
+}
+
+/**
+ * Checks the status transitions driven by the provider
+ */
+static void test_sync()
+{
+	unsigned int calls;
+	timelib_t saved;
+
+	timelib_virtual_start(0);
+	TEST_EQUAL(timelib_get_status(), E_TIME_NOT_SET);
+
+	// A failed first sync keeps the clock not set
+	provider_down = true;
+	timelib_set_provider(provider, TIMELIB_SECS_PER_HOUR);
+	timelib_get();
+	TEST_EQUAL(timelib_get_status(), E_TIME_NOT_SET);
+
+	// The provider is retried on the first read after the sync interval
+	provider_down = false;
+	calls = provider_calls;
+	timelib_virtual_forward(0, 0, TIMELIB_SECS_PER_HOUR * TICK_SECOND, 0);
+	TEST_EQUAL(provider_calls, calls);
+	timelib_get();
+	TEST_EQUAL(provider_calls, calls + 1);
+	TEST_EQUAL(timelib_get_status(), E_TIME_OK);
+	TEST_EQUAL(timelib_get(), provider());
+
+	// A failed sync of a running clock asks for a new sync
+	provider_down = true;
+	timelib_virtual_forward(0, 0, TIMELIB_SECS_PER_HOUR * TICK_SECOND, 0);
+	TEST_EQUAL(timelib_get_status(), E_TIME_NEEDS_SYNC);
+	provider_down = false;
+	TEST_EQUAL(timelib_get(), provider());
+
+	// And recovers on the next one
+	timelib_virtual_forward(0, 0, TIMELIB_SECS_PER_HOUR * TICK_SECOND, 0);
+	TEST_EQUAL(timelib_get_status(), E_TIME_OK);
+
+	// A halted clock does not move nor sync
+	timelib_halt_clock();
+	saved = timelib_get();
+	calls = provider_calls;
+	timelib_virtual_forward(0, 0, 2 * TIMELIB_SECS_PER_HOUR * TICK_SECOND, 0);
+	TEST_EQUAL(provider_calls, calls);
+	TEST_EQUAL(timelib_get(), saved);
+	timelib_resume_clock();
+	timelib_virtual_stop();
+}
+
+/**
+ * Provider for the second clock, one hour ahead of the reference
+ */
+static timelib_t clock_provider(struct timelib_clock * clock)
+{
+	(void) clock;
+	return REFERENCE + TIMELIB_SECS_PER_HOUR + (timelib_t) (timelib_virtual_ticks() / TICK_SECOND);
+}
+
+/**
+ * Checks that clock instances run independently of the default clock
+ */
+static void test_instances()
+{
+	struct timelib_clock clocks[2];
+
+	timelib_virtual_start(0);
+	timelib_set(REFERENCE);
+	timelib_clock_init(&clocks[0]);
+	timelib_clock_init(&clocks[1]);
+	TEST_EQUAL(timelib_clock_get(&clocks[0]), 0);
+	TEST_EQUAL(timelib_clock_get_status(&clocks[0]), E_TIME_NOT_SET);
+	timelib_clock_set_provider(&clocks[0], clock_provider, TIMELIB_SECS_PER_DAY);
+	TEST_EQUAL(timelib_clock_get(&clocks[0]), REFERENCE + TIMELIB_SECS_PER_HOUR);
+	timelib_clock_set(&clocks[1], 1000);
+
+	// Each clock keeps its own time, halting one does not stop the others
+	timelib_clock_halt(&clocks[1]);
+	timelib_virtual_step(90 * TICK_SECOND);
+	TEST_EQUAL(timelib_clock_get(&clocks[0]), REFERENCE + TIMELIB_SECS_PER_HOUR + 90);
+	TEST_EQUAL(timelib_get(), REFERENCE + 90);
+	TEST_EQUAL(timelib_clock_get(&clocks[1]), 1000);
+	timelib_clock_resume(&clocks[1]);
+
+	// Advancing all of them from a single tick reading
+	timelib_virtual_step(10 * TICK_SECOND);
+	timelib_clock_advance_all(clocks, 2);
+	TEST_EQUAL(clocks[0].time, REFERENCE + TIMELIB_SECS_PER_HOUR + 100);
+	TEST_EQUAL(clocks[1].time, 1000 + 100);
+	timelib_virtual_stop();
+}
+
+/**
+ * Checks that a replayed trace gives the same clock readings every run
+ */
+static void test_replay()
+{
+	static const unsigned long trace[] = {0, 0, 999, 1000, 2500, 61000};
+	static const timelib_t expect[] = {0, 0, 1, 2, 61};
+	size_t i;
+
+	timelib_virtual_replay(trace, sizeof(trace) / sizeof(trace[0]));
+	timelib_set(REFERENCE);
+	for (i = 0; i < sizeof(expect) / sizeof(expect[0]); i++)
+		TEST_EQUAL(timelib_get(), REFERENCE + expect[i]);
+	// The last reading repeats once the trace is exhausted
+	TEST_EQUAL(timelib_get(), REFERENCE + 61);
+	timelib_virtual_stop();
+}
+
+/**
+ * Checks the time and fields read at once against a separate break down
+ */
+static void test_now_tm()
+{
+	struct timelib_clock clock;
+	struct timelib_tm tm, expect;
+	unsigned long elapsed = 0, step;
+	uint16_t ms;
+	timelib_t now;
+	unsigned int i;
+
+	// A clock without provider, so the fraction of second is never reset
+	timelib_virtual_start(0);
+	timelib_clock_init(&clock);
+	timelib_clock_set(&clock, REFERENCE);
+	for (i = 0; i < 5000; i++) {
+		step = test_random() % (3 * TIMELIB_SECS_PER_DAY * TICK_SECOND);
+		timelib_virtual_step(step);
+		elapsed += step;
+		now = timelib_clock_now_tm(&clock, &tm, &ms);
+		TEST_EQUAL(now, REFERENCE + elapsed / TICK_SECOND);
+		TEST_EQUAL(ms, (elapsed % TICK_SECOND) * 1000UL / TICK_SECOND);
+		timelib_break(now, &expect);
+		TEST_EQUAL(tm.tm_sec, expect.tm_sec);
+		TEST_EQUAL(tm.tm_min, expect.tm_min);
+		TEST_EQUAL(tm.tm_hour, expect.tm_hour);
+		TEST_EQUAL(tm.tm_wday, expect.tm_wday);
+		TEST_EQUAL(tm.tm_mday, expect.tm_mday);
+		TEST_EQUAL(tm.tm_mon, expect.tm_mon);
+		TEST_EQUAL(tm.tm_year, expect.tm_year);
+	}
+	timelib_virtual_stop();
+}
+
+int main()
+{
+	test_sync();
+	test_instances();
+	test_replay();
+	test_now_tm();
+	return TEST_RESULT("test_clock");
+}
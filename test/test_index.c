@@ -0,0 +1,146 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Range index searches and bucket queries checked against linear scans.
+ */
+#include "TimeLibIndex.h"
+#include "TimeLibTest.h"
+
+/* Number of timestamps on the sorted array */
+#define INDEX_COUNT	5000
+/* Size of the directory, smaller than the buckets of most units */
+#define INDEX_DIR	40
+
+/**
+ * Counts the elements of a bucket and finds its bounds with a linear scan
+ */
+static size_t reference_bucket(const timelib_t * times, size_t count, enum timelib_bucket_unit unit, int32_t offset, uint32_t bucket, size_t * begin, size_t * end)
+{
+	uint32_t index;
+	size_t i;
+
+	*begin = count;
+	*end = count;
+	for (i = 0; i < count; i++) {
+		timelib_bucket_index(&times[i], &index, 1, unit, offset);
+		if (index >= bucket && *begin == count)
+			*begin = i;
+		if (index > bucket) {
+			*end = i;
+			break;
+		}
+	}
+	return *end - *begin;
+}
+
+/**
+ * Checks the buckets that start before the epoch
+ */
+static void test_clamp()
+{
+	static const timelib_t times[] = {10, 3000, 100000, 300000, 400000};
+	struct timelib_index idx;
+	size_t begin, end;
+
+	// Week 0 started on Dec 29, 1969
+	timelib_index_build(&idx, times, 5, E_TIMELIB_BUCKET_WEEK, 0, 0, 0);
+	TEST_EQUAL(timelib_index_bucket(&idx, 0, &begin, &end), 4);
+	TEST_EQUAL(begin, 0);
+	TEST_EQUAL(end, 4);
+
+	// With a positive offset day and hour 0 start before the epoch
+	timelib_index_build(&idx, times, 5, E_TIMELIB_BUCKET_DAY, 3600, 0, 0);
+	TEST_EQUAL(timelib_index_bucket(&idx, 0, &begin, &end), 2);
+	TEST_EQUAL(begin, 0);
+	timelib_index_build(&idx, times, 5, E_TIMELIB_BUCKET_HOUR, 3600, 0, 0);
+	TEST_EQUAL(timelib_index_bucket(&idx, 1, &begin, &end), 2);
+	TEST_EQUAL(end, 2);
+}
+
+/**
+ * Checks searches and bucket queries on random sorted timestamps
+ */
+static void test_queries()
+{
+	static const int32_t offsets[] = {0, 3600, -6 * 3600};
+	static timelib_t times[INDEX_COUNT], keys[64];
+	static size_t dir[INDEX_DIR], pos[64], counts[INDEX_DIR * 2];
+	struct timelib_index idx;
+	size_t i, k, begin, end, rbegin, rend, n;
+	uint32_t first, bucket;
+	unsigned int u, o;
+	timelib_t time = 1500000000UL;
+
+	for (i = 0; i < INDEX_COUNT; i++) {
+		// Repeated timestamps, short gaps and gaps of several days
+		time += (test_random() % 8 == 0) ? test_random() % (4 * TIMELIB_SECS_PER_DAY) : test_random() % 600;
+		times[i] = time;
+	}
+
+	// Searches against a linear scan, single and interleaved
+	for (k = 0; k < 64; k++)
+		keys[k] = times[0] - 1000 + (timelib_t) (test_random() % (time - times[0] + 2000));
+	timelib_index_lower_batch(times, INDEX_COUNT, keys, pos, 64);
+	for (k = 0; k < 64; k++) {
+		for (i = 0; i < INDEX_COUNT && times[i] < keys[k]; i++);
+		TEST_EQUAL(timelib_index_lower(times, INDEX_COUNT, keys[k]), i);
+		TEST_EQUAL(pos[k], i);
+	}
+
+	for (u = E_TIMELIB_BUCKET_HOUR; u <= E_TIMELIB_BUCKET_MONTH; u++) {
+		for (o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+			timelib_bucket_index(times, &first, 1, (enum timelib_bucket_unit) u, offsets[o]);
+			timelib_bucket_index(&times[INDEX_COUNT - 1], &bucket, 1, (enum timelib_bucket_unit) u, offsets[o]);
+			n = bucket - first + 3;
+			if (n > INDEX_DIR * 2)
+				n = INDEX_DIR * 2;
+			// With a directory that covers the first buckets and without one
+			for (k = 0; k < 2; k++) {
+				timelib_index_build(&idx, times, INDEX_COUNT, (enum timelib_bucket_unit) u, offsets[o], k ? dir : 0, INDEX_DIR);
+				timelib_index_counts(&idx, first - 1, counts, n);
+				for (i = 0; i < n; i++) {
+					TEST_EQUAL(timelib_index_bucket(&idx, first - 1 + (uint32_t) i, &begin, &end),
+						reference_bucket(times, INDEX_COUNT, (enum timelib_bucket_unit) u, offsets[o], first - 1 + (uint32_t) i, &rbegin, &rend));
+					TEST_EQUAL(begin, rbegin);
+					TEST_EQUAL(end, rend);
+					TEST_EQUAL(counts[i], rend - rbegin);
+				}
+			}
+		}
+	}
+
+	// Ranges against a linear count
+	timelib_index_build(&idx, times, INDEX_COUNT, E_TIMELIB_BUCKET_DAY, 0, dir, INDEX_DIR);
+	for (k = 0; k < 64; k++) {
+		time = keys[k] + (timelib_t) (test_random() % (2 * TIMELIB_SECS_PER_DAY));
+		n = 0;
+		for (i = 0; i < INDEX_COUNT; i++)
+			n += (times[i] >= keys[k] && times[i] < time) ? 1 : 0;
+		TEST_EQUAL(timelib_index_range(&idx, keys[k], time, &begin, &end), n);
+		TEST_EQUAL(end - begin, n);
+	}
+}
+
+int main()
+{
+	test_clamp();
+	test_queries();
+	return TEST_RESULT("test_index");
+}
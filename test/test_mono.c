@@ -0,0 +1,95 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Monotonic clock across tick counter wrap arounds on simulated time. Build
+ * with CONFIG_TIMELIB_MONO defined.
+ */
+#include "TimeLibVirtual.h"
+#include "TimeLibTest.h"
+
+#if !defined(CONFIG_TIMELIB_MONO)
+#error "Define CONFIG_TIMELIB_MONO to build this test"
+#endif
+
+/* Reference time at the start of the test */
+#define REFERENCE	1500000000UL
+
+/**
+ * Checks the elapsed microseconds against the sum of the random steps
+ */
+static void test_wrap()
+{
+	uint64_t start, last, now, elapsed = 0;
+	unsigned long step;
+	unsigned int i;
+
+	// Start close to the wrap around of the tick counter
+	timelib_virtual_start(0UL - 50000UL * (unsigned long) TICK_SECOND / 1000UL);
+	start = last = timelib_mono_us();
+	for (i = 0; i < 20000; i++) {
+		step = test_random() % 10000;
+		timelib_virtual_step(step);
+		elapsed += (uint64_t) step * 1000000ULL / (uint64_t) TICK_SECOND;
+		now = timelib_mono_us();
+		TEST_CHECK(now >= last);
+		TEST_EQUAL(now - start, elapsed);
+		last = now;
+	}
+	// The counter went through at least one wrap around
+	TEST_CHECK(elapsed > 50000000ULL);
+	timelib_virtual_stop();
+}
+
+/**
+ * Checks the wall time estimate of monotonic instants
+ */
+static void test_to_wall()
+{
+	uint64_t mono;
+	uint16_t ms;
+
+	timelib_virtual_start(123456);
+	timelib_set(REFERENCE);
+	mono = timelib_mono_us();
+	TEST_EQUAL(timelib_mono_to_wall(mono, &ms), REFERENCE);
+	TEST_EQUAL(ms, 0);
+
+	// Instants in the past and in the future of the clock
+	timelib_virtual_step(2500 * (unsigned long) TICK_SECOND / 1000UL);
+	TEST_EQUAL(timelib_get(), REFERENCE + 2);
+	TEST_EQUAL(timelib_mono_to_wall(mono + 1250000ULL, &ms), REFERENCE + 1);
+	TEST_EQUAL(ms, 250);
+	TEST_EQUAL(timelib_mono_to_wall(timelib_mono_us() + 600000ULL, &ms), REFERENCE + 3);
+	TEST_EQUAL(ms, 100);
+
+	// Setting the clock moves the estimate but not the monotonic clock
+	mono = timelib_mono_us();
+	timelib_set(REFERENCE + 3600);
+	TEST_EQUAL(timelib_mono_us(), mono);
+	TEST_EQUAL(timelib_mono_to_wall(mono, &ms), REFERENCE + 3600);
+	timelib_virtual_stop();
+}
+
+int main()
+{
+	test_wrap();
+	test_to_wall();
+	return TEST_RESULT("test_mono");
+}
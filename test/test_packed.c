@@ -0,0 +1,116 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Calendar break down and packed date/time codec against a day by day walk of
+ * the calendar.
+ */
+#include "TimeLib.h"
+#include "TimeLibTest.h"
+
+/* Number of timestamps on the array test */
+#define ARRAY_COUNT	2000
+
+/* Last day of the range of timelib_t, Feb 6, 2106 */
+#define LAST_DAY	49709UL
+
+/**
+ * Checks the fields of a time structure against the walked date
+ */
+static void check_fields(const struct timelib_tm * tm, unsigned int year, unsigned int month, unsigned int day, uint32_t secs, uint32_t days)
+{
+	TEST_EQUAL(tm->tm_year, year - 1970);
+	TEST_EQUAL(tm->tm_mon, month);
+	TEST_EQUAL(tm->tm_mday, day);
+	TEST_EQUAL(tm->tm_hour, secs / TIMELIB_SECS_PER_HOUR);
+	TEST_EQUAL(tm->tm_min, (secs / TIMELIB_SECS_PER_MINUTE) % 60);
+	TEST_EQUAL(tm->tm_sec, secs % 60);
+	TEST_EQUAL(tm->tm_wday, ((days + 4) % 7) + 1);
+}
+
+/**
+ * Walks every day of the timestamp range checking break down and packing
+ */
+static void test_walk()
+{
+	static const uint8_t length[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+	unsigned int year = 1970, month = 1, day = 1, leap;
+	struct timelib_tm tm;
+	timelib_packed_t packed;
+	timelib_t time;
+	uint32_t days, secs;
+
+	for (days = 0; days <= LAST_DAY; days++) {
+		secs = test_random() % TIMELIB_SECS_PER_DAY;
+		time = (timelib_t) days * TIMELIB_SECS_PER_DAY + secs;
+		timelib_break(time, &tm);
+		check_fields(&tm, year, month, day, secs, days);
+		TEST_EQUAL(timelib_make(&tm), time);
+
+		packed = timelib_pack(time);
+		if (year < 1970 + CONFIG_TIMELIB_PACKED_BASE || year > 1970 + CONFIG_TIMELIB_PACKED_BASE + 63) {
+			TEST_EQUAL(packed, TIMELIB_PACKED_INVALID);
+		} else {
+			TEST_EQUAL(timelib_unpack(packed), time);
+			timelib_unpack_tm(packed, &tm);
+			check_fields(&tm, year, month, day, secs, days);
+			TEST_EQUAL(timelib_pack_tm(&tm), packed);
+		}
+
+		// Next day of the walk
+		leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+		if (++day > length[month - 1] + (month == 2 ? leap : 0)) {
+			day = 1;
+			if (++month > 12) {
+				month = 1;
+				year++;
+			}
+		}
+	}
+}
+
+/**
+ * Checks the array conversions against the single value ones
+ */
+static void test_array()
+{
+	static timelib_t times[ARRAY_COUNT], back[ARRAY_COUNT];
+	static timelib_packed_t packed[ARRAY_COUNT];
+	timelib_t time = 946684800UL; // Jan 1, 2000
+	size_t i;
+
+	// Sorted timestamps with gaps within a day and across several days
+	for (i = 0; i < ARRAY_COUNT; i++) {
+		time += (test_random() % 4 == 0) ? test_random() % (5 * TIMELIB_SECS_PER_DAY) : test_random() % 600;
+		times[i] = time;
+	}
+	timelib_pack_array(times, packed, ARRAY_COUNT);
+	timelib_unpack_array(packed, back, ARRAY_COUNT);
+	for (i = 0; i < ARRAY_COUNT; i++) {
+		TEST_EQUAL(packed[i], timelib_pack(times[i]));
+		TEST_EQUAL(back[i], times[i]);
+	}
+}
+
+int main()
+{
+	test_walk();
+	test_array();
+	return TEST_RESULT("test_packed");
+}
@@ -0,0 +1,98 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Round trips of the compressed timestamp series codec.
+ */
+#include "TimeLibSeries.h"
+#include "TimeLibTest.h"
+
+/* Number of timestamps on the series test */
+#define SERIES_COUNT	1000
+
+/**
+ * Encodes a series with regular and irregular gaps and decodes it back
+ */
+static void test_series()
+{
+	static timelib_t times[SERIES_COUNT], out[CONFIG_TIMELIB_SERIES_BLOCK];
+	static uint8_t buf[SERIES_COUNT * 8];
+	struct timelib_series s;
+	struct timelib_series_reader r;
+	struct timelib_tm tm[CONFIG_TIMELIB_SERIES_BLOCK], ref;
+	size_t i, n, size;
+	uint8_t count, k;
+
+	times[0] = 1500000000UL;
+	for (i = 1; i < SERIES_COUNT; i++) {
+		// Mostly one minute samples with jitter, gaps and repeats
+		switch (test_random() % 8) {
+		case 0:
+			times[i] = times[i - 1] + test_random() % 100000;
+			break;
+		case 1:
+			times[i] = times[i - 1];
+			break;
+		case 2:
+			times[i] = times[i - 1] + 60 + test_random() % 3 - 1;
+			break;
+		default:
+			times[i] = times[i - 1] + 60;
+			break;
+		}
+	}
+
+	timelib_series_init(&s, buf, sizeof(buf));
+	for (i = 0; i < SERIES_COUNT; i++)
+		TEST_CHECK(timelib_series_put(&s, times[i]));
+	size = timelib_series_finish(&s);
+	TEST_CHECK(size < SERIES_COUNT * sizeof(timelib_t));
+
+	timelib_series_reader_init(&r, buf, size);
+	n = 0;
+	while ((count = timelib_series_read(&r, out)) != 0) {
+		for (k = 0; k < count && n + k < SERIES_COUNT; k++)
+			TEST_EQUAL(out[k], times[n + k]);
+		n += count;
+	}
+	TEST_EQUAL(n, SERIES_COUNT);
+
+	// Seek to a block and decode it to time structures
+	timelib_series_reader_init(&r, buf, size);
+	TEST_CHECK(timelib_series_seek(&r, 2));
+	count = timelib_series_read_tm(&r, tm);
+	TEST_CHECK(count != 0);
+	for (k = 0; k < count; k++) {
+		timelib_break(times[2 * CONFIG_TIMELIB_SERIES_BLOCK + k], &ref);
+		TEST_EQUAL(timelib_make(&tm[k]), timelib_make(&ref));
+	}
+	TEST_CHECK(!timelib_series_seek(&r, SERIES_COUNT));
+
+	// A full buffer refuses more timestamps
+	timelib_series_init(&s, buf, 16);
+	for (i = 0; i < SERIES_COUNT && timelib_series_put(&s, times[i]); i++)
+		;
+	TEST_CHECK(i < SERIES_COUNT);
+}
+
+int main()
+{
+	test_series();
+	return TEST_RESULT("test_series");
+}
@@ -0,0 +1,121 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * NTP timestamp conversions, SNTP offset computation and the non blocking
+ * client on simulated time.
+ */
+#include "TimeLibSntp.h"
+#include "TimeLibVirtual.h"
+#include "TimeLibTest.h"
+
+#include <string.h>
+
+/* Server time at tick zero */
+#define REFERENCE	1500000000UL
+
+/**
+ * Checks the NTP timestamp conversions
+ */
+static void test_ntp()
+{
+	struct timelib_sntp_sample sample;
+	timelib_ntp_t ntp;
+	timelib_t time;
+	uint32_t us, back;
+	int i;
+
+	// Exact microseconds both ways over the full range of timelib_t
+	for (i = 0; i < 10000; i++) {
+		time = (timelib_t) test_random() << 8 | (timelib_t) (test_random() & 0xFF);
+		us = test_random() % 1000000UL;
+		ntp = timelib_ntp_from_time(time, us);
+		TEST_EQUAL(timelib_ntp_to_time(ntp, &back), time);
+		TEST_EQUAL(back, us);
+	}
+
+	// Epochs and the 2036 era rollover
+	TEST_EQUAL(timelib_ntp_from_time(0, 0) >> 32, TIMELIB_NTP_UNIX_OFFSET);
+	TEST_EQUAL(timelib_ntp_from_time(2085978496UL, 0) >> 32, 0);
+	TEST_EQUAL(timelib_ntp_to_time(0, 0), 2085978496UL);
+	TEST_EQUAL(timelib_ntp_to_time(timelib_ntp_from_time(0xFFFFFFFFUL, 0), 0), 0xFFFFFFFFUL);
+
+	// Intervals across the rollover and with both signs
+	TEST_EQUAL(timelib_ntp_interval(timelib_ntp_from_time(2085978496UL, 250000),
+		timelib_ntp_from_time(2085978495UL, 750000)), 500000);
+	TEST_EQUAL(timelib_ntp_interval(timelib_ntp_from_time(100, 0), timelib_ntp_from_time(101, 500000)), -1500000);
+
+	// Offset and delay of a server 2 s ahead with 40 ms each way
+	sample.t1 = timelib_ntp_from_time(1000, 0);
+	sample.t2 = timelib_ntp_from_time(1002, 40000);
+	sample.t3 = timelib_ntp_from_time(1002, 50000);
+	sample.t4 = timelib_ntp_from_time(1000, 90000);
+	timelib_sntp_compute(&sample);
+	TEST_EQUAL(sample.offset, 2000000);
+	TEST_EQUAL(sample.delay, 80000);
+}
+
+/**
+ * Checks the non blocking SNTP mode against a loopback server
+ */
+static void test_sntp_async()
+{
+	struct timelib_sntp_server server;
+	struct timelib_clock clock;
+	uint8_t late[TIMELIB_SNTP_PACKET_SIZE];
+
+	timelib_virtual_start(0);
+	timelib_clock_init(&clock);
+	timelib_sntp_server_init(&server, REFERENCE);
+	timelib_sntp_setup_async(timelib_sntp_loopback_send, timelib_sntp_loopback_recv, &server);
+	TEST_CHECK(!timelib_sntp_poll(&clock));
+
+	// The reply is taken on the first poll after it arrives
+	TEST_CHECK(timelib_sntp_request());
+	TEST_CHECK(timelib_sntp_pending());
+	timelib_virtual_step(40);
+	TEST_CHECK(timelib_sntp_poll(&clock));
+	TEST_CHECK(!timelib_sntp_pending());
+	TEST_EQUAL(timelib_clock_get(&clock), REFERENCE);
+	TEST_EQUAL(timelib_clock_get_status(&clock), E_TIME_OK);
+	TEST_EQUAL(server.requests, 1);
+
+	// Late replies to a replaced request are discarded
+	timelib_virtual_step(10 * TICK_SECOND);
+	TEST_CHECK(timelib_sntp_request());
+	memcpy(late, server.reply, sizeof(late));
+	timelib_virtual_step(1);
+	TEST_CHECK(timelib_sntp_request());
+	memcpy(server.reply, late, sizeof(late));
+	TEST_CHECK(!timelib_sntp_poll(&clock));
+	TEST_CHECK(timelib_sntp_pending());
+
+	// A request without reply is dropped after the timeout
+	timelib_virtual_step(CONFIG_TIMELIB_SNTP_TIMEOUT);
+	TEST_CHECK(!timelib_sntp_poll(&clock));
+	TEST_CHECK(!timelib_sntp_pending());
+	TEST_EQUAL(timelib_clock_get(&clock), REFERENCE + 11);
+}
+
+int main()
+{
+	test_ntp();
+	test_sntp_async();
+	return TEST_RESULT("test_sntp");
+}
@@ -0,0 +1,133 @@
+/*	TimeLib - Time management library for embedded devices
+	Copyright (C) 2014 Jesus Ruben Santa Anna Zamudio.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Author website: http://www.geekfactory.mx
+	Author e-mail: ruben at geekfactory dot mx
+ */
+/*
+ * Selection of the time among several sources checked against a brute force
+ * majority count, on simulated time so readings take no time.
+ */
+#include "TimeLibSources.h"
+#include "TimeLibVirtual.h"
+#include "TimeLibTest.h"
+
+/* Reference time of the readings */
+#define REFERENCE	1500000000UL
+/* Number of random scenarios */
+#define SCENARIOS	20000
+
+/* Reading returned by each source, 0 for a failed reading */
+static timelib_t readings[4];
+
+static timelib_t source0() { return readings[0]; }
+static timelib_t source1() { return readings[1]; }
+static timelib_t source2() { return readings[2]; }
+static timelib_t source3() { return readings[3]; }
+
+static const timelib_callback_t sources[4] = {source0, source1, source2, source3};
+
+/**
+ * Checks that a lone answer cannot step the clock while other sources fail
+ */
+static void test_lone()
+{
+	uint8_t i;
+
+	for (i = 0; i < 3; i++)
+		timelib_sources_add(sources[i], i);
+	readings[0] = REFERENCE;
+	readings[1] = REFERENCE + 1;
+	readings[2] = REFERENCE + 600;
+	TEST_CHECK(timelib_sources_get() <= REFERENCE + 1);
+	TEST_CHECK(timelib_sources_get() >= REFERENCE);
+	// The outlier lost reliability
+	TEST_CHECK(timelib_sources_info(2)->score < TIMELIB_SOURCES_SCORE_INIT);
+
+	readings[0] = readings[1] = 0;
+	TEST_EQUAL(timelib_sources_get(), 0);
+	readings[1] = REFERENCE + 1;
+	TEST_EQUAL(timelib_sources_get(), 0);
+
+	// Once removed the silent source does not count anymore
+	timelib_sources_remove(source0);
+	TEST_EQUAL(timelib_sources_get(), 0);
+	timelib_sources_remove(source1);
+	TEST_EQUAL(timelib_sources_get(), REFERENCE + 600);
+	timelib_sources_remove(source2);
+	TEST_EQUAL(timelib_sources_get(), 0);
+}
+
+/**
+ * Checks random scenarios against a brute force count of the agreeing
+ * readings
+ */
+static void test_random_scenarios()
+{
+	static const timelib_t offsets[] = {0, 1, 2, 3, 30, 31, 100};
+	uint8_t registered, i, j, agree;
+	timelib_t result;
+	bool majority, close;
+	int32_t diff;
+	unsigned int n;
+
+	for (n = 0; n < SCENARIOS; n++) {
+		registered = (uint8_t) (test_random() % 4 + 1);
+		for (i = 0; i < 4; i++) {
+			timelib_sources_remove(sources[i]);
+			readings[i] = 0;
+		}
+		for (i = 0; i < registered; i++) {
+			timelib_sources_add(sources[i], (uint8_t) (test_random() % 4));
+			if (test_random() % 4 != 0)
+				readings[i] = REFERENCE + offsets[test_random() % (sizeof(offsets) / sizeof(offsets[0]))];
+		}
+		result = timelib_sources_get();
+
+		// The result is within tolerance of a reading that agrees with
+		// more than half of the registered sources
+		majority = false;
+		close = false;
+		for (i = 0; i < registered; i++) {
+			if (readings[i] == 0)
+				continue;
+			agree = 0;
+			for (j = 0; j < registered; j++) {
+				diff = (int32_t) (readings[j] - readings[i]);
+				if (readings[j] != 0 && diff >= -CONFIG_TIMELIB_SOURCES_TOLERANCE && diff <= CONFIG_TIMELIB_SOURCES_TOLERANCE)
+					agree++;
+			}
+			if (agree * 2 > registered) {
+				majority = true;
+				diff = (int32_t) (result - readings[i]);
+				if (diff >= -CONFIG_TIMELIB_SOURCES_TOLERANCE && diff <= CONFIG_TIMELIB_SOURCES_TOLERANCE)
+					close = true;
+			}
+		}
+		TEST_EQUAL(result != 0, majority);
+		if (majority)
+			TEST_CHECK(close);
+	}
+}
+
+int main()
+{
+	timelib_virtual_start(0);
+	test_lone();
+	test_random_scenarios();
+	timelib_virtual_stop();
+	return TEST_RESULT("test_sources");
+}